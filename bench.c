@@ -0,0 +1,547 @@
+#include "cache.h"
+#include "eviction.h"
+#include "list_utils.h"
+#include "oracle.h"
+#include "sim.h"
+#include "rng.h"
+#include "timer.h"
+#include "reduction.h"
+#include "traversal.h"
+#include "threshold.h"
+#include "pool.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Benchmark driver: sweeps the initial set size, rounds, associativity,
+ * stride, algorithm and eviction strategy over seeded trials, and writes one
+ * record per trial as JSON and/or CSV. Trial i of every configuration uses
+ * seed + i, so two builds compare on the same candidate sets.
+ */
+
+#define BENCH_MAX_VALUES 16
+
+static const char *policies[] = { "lru", "plru", "qlru" };
+
+struct sweep_t {
+	int v[BENCH_MAX_VALUES];
+	int n;
+};
+
+struct trial_t {
+	int size, rounds, ways, stride, trial;
+	char algorithm;
+	const struct traversal_t *traversal;
+	uint64_t seed;
+	int ok, congruent, len;
+	double seconds;
+	struct eviction_stats_t stats;
+};
+
+static int saved_stdout = -1;
+
+// Library progress lines go to /dev/null while a trial runs
+static void
+quiet(int on)
+{
+	int fd;
+
+	fflush(stdout);
+	if (on && saved_stdout < 0) {
+		fd = open("/dev/null", O_WRONLY);
+		if (fd < 0) {
+			return;
+		}
+		saved_stdout = dup(STDOUT_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+	} else if (!on && saved_stdout >= 0) {
+		dup2(saved_stdout, STDOUT_FILENO);
+		close(saved_stdout);
+		saved_stdout = -1;
+	}
+}
+
+/**
+ * Parses a comma separated list of integers into s.
+ *
+ * @return 0 on success, -1 on an empty, malformed or too long list.
+ */
+static int
+parse_list(const char *arg, struct sweep_t *s)
+{
+	char *end;
+
+	s->n = 0;
+	do {
+		if (s->n == BENCH_MAX_VALUES) {
+			return -1;
+		}
+		s->v[s->n++] = strtol(arg, &end, 0);
+		if (end == arg || (*end && *end != ',')) {
+			return -1;
+		}
+		arg = end + 1;
+	} while (*end);
+	return 0;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void
+strategy(const struct traversal_t *t, char *buf, size_t len)
+{
+	if (!t) {
+		snprintf(buf, len, "simple:1/1/1/0");
+	} else {
+		snprintf(buf, len, "%s:%d/%d/%d/%d", t->name, t->repeat, t->window, t->step, t->back);
+	}
+}
+
+static void
+json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', f);
+		}
+		if ((unsigned char)*s >= 0x20) {
+			fputc(*s, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void
+write_json(FILE *f, struct trial_t *r, int first)
+{
+	char name[64];
+
+	strategy(r->traversal, name, sizeof(name));
+	fprintf(f, "%s\n    {\"algorithm\": \"%c\", \"strategy\": \"%s\", \"size\": %d, \"rounds\": %d, "
+		   "\"ways\": %d, \"stride\": %d, \"trial\": %d, \"seed\": %llu, \"ok\": %d, \"congruent\": %d, "
+		   "\"len\": %d, \"seconds\": %.6f, \"tests\": %lu, \"probes\": %lu, \"lines\": %lu, "
+		   "\"backtracks\": %lu, \"retries\": %lu}",
+		first ? "" : ",", r->algorithm, name, r->size, r->rounds, r->ways, r->stride, r->trial,
+		(unsigned long long)r->seed, r->ok, r->congruent, r->len, r->seconds, r->stats.tests,
+		r->stats.probes, r->stats.lines, r->stats.backtracks, r->stats.retries);
+}
+
+static void
+write_csv(FILE *f, struct trial_t *r)
+{
+	char name[64];
+
+	strategy(r->traversal, name, sizeof(name));
+	fprintf(f, "%c,%s,%d,%d,%d,%d,%d,%llu,%d,%d,%d,%.6f,%lu,%lu,%lu,%lu,%lu\n", r->algorithm, name, r->size,
+		r->rounds, r->ways, r->stride, r->trial, (unsigned long long)r->seed, r->ok, r->congruent, r->len,
+		r->seconds, r->stats.tests, r->stats.probes, r->stats.lines, r->stats.backtracks,
+		r->stats.retries);
+}
+
+/*
+ * With the simulator, a set only counts as congruent if every line maps to
+ * the victim's cache set and slice. On hardware a found set is taken at its
+ * word (the final test of the reduction), so congruent follows ok.
+ */
+static int
+congruent(struct sim_t *sim, char *victim, cache_block_t *set)
+{
+	uint64_t v, p;
+
+	if (!sim) {
+		return 1;
+	}
+	v = sim_paddr(sim, victim);
+	for (; set; set = set->next) {
+		p = sim_paddr(sim, set);
+		if (sim_set(sim, p) != sim_set(sim, v) || sim_slice(sim, p) != sim_slice(sim, v)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Runs one trial: a fresh simulator (if any) and random state from r->seed,
+ * then a single search for victim.
+ *
+ * @return 0 if the trial ran, -1 if the configuration is invalid.
+ */
+static int
+run_trial(char *pool, unsigned long pool_sz, char *victim, struct eviction_config_t conf, struct sim_config_t *sc,
+	  struct trial_t *r)
+{
+	struct sim_t sim;
+	struct oracle_t oracle;
+	struct eviction_set_t es = { 0 };
+	cache_block_t *set = NULL;
+	double start;
+
+	memset(&r->stats, 0, sizeof(r->stats));
+	if (sc) {
+		sc->ways = conf.cache_way;
+		sc->sets = conf.cache_size / (64 * conf.cache_way * conf.cache_slices);
+		sc->seed = r->seed;
+		if (sim_init(&sim, sc)) {
+			return -1;
+		}
+		sim_oracle_init(&oracle, &sim);
+		conf.oracle = &oracle;
+	}
+	conf.stats = &r->stats;
+	rng_seed(r->seed);
+
+	start = now();
+	if (conf.algorithm == 'l') {
+		r->ok = !find_any_eviction_set(pool, pool_sz, conf, &es);
+		victim = es.victim;
+		set = es.set;
+	} else {
+		r->ok = !find_eviction_set(pool, pool_sz, victim, conf, &set);
+	}
+	r->seconds = now() - start;
+
+	r->len = r->ok ? list_length(set) : 0;
+	r->congruent = r->ok && congruent(sc ? &sim : NULL, victim, set);
+	if (sc) {
+		sim_free(&sim);
+	}
+	return 0;
+}
+
+static void
+usage(char *name)
+{
+	printf("[?] Usage: %s [flags] [params]\n\n"
+	       "\tSweeps every combination of the listed values, --trials seeded trials each.\n"
+	       "\tFlags:\n"
+	       "\t\t--simulate\t(use the software cache simulator as oracle)\n"
+	       "\t\t--verbose\t(keep the output of the searches)\n"
+	       "\tParams:\n"
+	       "\t\t-b N[,N..]\tnumber of lines in initial buffer (default: 8192)\n"
+	       "\t\t-r N[,N..]\tnumber of rounds per test (default: 10)\n"
+	       "\t\t-n N[,N..]\tcache associativity (default: 16)\n"
+	       "\t\t-o N[,N..]\tstride for blocks in bytes (default: 4096)\n"
+	       "\t\t-a A[,A..]\tsearch algorithms n|o|g|b|l (default: g)\n"
+	       "\t\t-e N|R,W,S[,B]\teviction strategy, repeat to sweep (default: simple)\n"
+	       "\t\t-c N\t\tcache size in MB (default: 12)\n"
+	       "\t\t-s N\t\tnumber of cache slices (default: 6)\n"
+	       "\t\t-t N\t\tthreshold in cycles (default: calibrates once per strategy)\n"
+	       "\t\t--trials N\ttrials per configuration (default: 10)\n"
+	       "\t\t--seed N\tseed of the first trial (default: 1)\n"
+	       "\t\t--policy P\tsimulated replacement: lru|plru|qlru (default: lru)\n"
+	       "\t\t--noise P\tsimulated measurement error probability (default: 0)\n"
+	       "\t\t--json F\twrite one record per trial to F\n"
+	       "\t\t--csv F\t\twrite one row per trial to F\n"
+	       "\t\t-h\t\tshow this help\n",
+	       name);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct eviction_config_t conf = {
+		.rounds = 10,
+		.cal_rounds = 1000000,
+		.stride = 4096,
+		.cache_size = 12 << 20,
+		.cache_way = 16,
+		.cache_slices = 6,
+		.initial_set_size = 8192,
+		.cal_confidence = 0.99,
+	};
+	struct sweep_t sizes = { { 8192 }, 1 }, rounds = { { 10 }, 1 }, ways = { { 16 }, 1 }, strides = { { 4096 }, 1 };
+	char algorithms[BENCH_MAX_VALUES] = { 'g' };
+	struct traversal_t custom[BENCH_MAX_VALUES];
+	const struct traversal_t *traversals[BENCH_MAX_VALUES] = { NULL };
+	int thresholds[BENCH_MAX_VALUES];
+	int nalgorithms = 1, ntraversals = 0, trials = 10, simulate = 0, verbose = 0, option, option_index = 0;
+	int a, e, b, r, n, o, c, k, i, total, threshold = 0, configs = 0, first = 1;
+	uint64_t seed = 1;
+	double noise = 0, *times;
+	enum sim_policy policy = SIM_LRU;
+	struct sim_config_t sim_conf;
+	struct oracle_t oracle;
+	const char *json = NULL, *csv = NULL;
+	FILE *fj = NULL, *fc = NULL;
+	char key[256], *buffer, *pool;
+	unsigned long pool_sz = 256 << 20, victims_sz;
+	struct pool_t mem;
+
+	static struct option long_options[] = {
+		{ "simulate", no_argument, 0, 'S' },
+		{ "verbose", no_argument, 0, 'v' },
+		{ "policy", required_argument, 0, 'P' },
+		{ "noise", required_argument, 0, 'N' },
+		{ "trials", required_argument, 0, 'T' },
+		{ "seed", required_argument, 0, 'R' },
+		{ "json", required_argument, 0, 'J' },
+		{ "csv", required_argument, 0, 'C' },
+		{ "help", no_argument, 0, 'h' },
+		{ 0, 0, 0, 0 },
+	};
+
+	while ((option = getopt_long(argc, argv, "b:r:n:o:a:e:c:s:t:h", long_options, &option_index)) != -1) {
+		switch (option) {
+		case 'b':
+		case 'r':
+		case 'n':
+		case 'o':
+			if (parse_list(optarg, option == 'b' ? &sizes : option == 'r' ? &rounds :
+							   option == 'n' ? &ways : &strides)) {
+				printf("[!] Error: bad list -%c %s\n", option, optarg);
+				return 1;
+			}
+			break;
+		case 'a':
+			for (nalgorithms = 0; *optarg && nalgorithms < BENCH_MAX_VALUES; optarg++) {
+				if (*optarg == ',') {
+					continue;
+				}
+				if (*optarg != 'l' && !reduction_find(*optarg)) {
+					printf("[!] Error: unknown algorithm %c\n", *optarg);
+					return 1;
+				}
+				algorithms[nalgorithms++] = *optarg;
+			}
+			break;
+		case 'e':
+			if (ntraversals == BENCH_MAX_VALUES ||
+			    traversal_parse(optarg, &custom[ntraversals], &traversals[ntraversals])) {
+				printf("[!] Error: unknown eviction strategy %s\n", optarg);
+				return 1;
+			}
+			ntraversals++;
+			break;
+		case 'c':
+			conf.cache_size = atoi(optarg) << 20;
+			break;
+		case 's':
+			conf.cache_slices = atoi(optarg);
+			break;
+		case 't':
+			threshold = atoi(optarg);
+			break;
+		case 'S':
+			simulate = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'P':
+			if (sim_parse_policy(optarg, &policy)) {
+				printf("[!] Error: unknown policy %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'N':
+			noise = atof(optarg);
+			break;
+		case 'T':
+			trials = atoi(optarg);
+			break;
+		case 'R':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'J':
+			json = optarg;
+			break;
+		case 'C':
+			csv = optarg;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return option != 'h';
+		}
+	}
+	if (!ntraversals) {
+		ntraversals = 1;
+	}
+	if (trials < 1 || trials > (1 << 13)) {
+		printf("[!] Error: --trials must be between 1 and %d\n", 1 << 13);
+		return 1;
+	}
+
+	times = (double *)calloc(trials, sizeof(double));
+	if (!times) {
+		printf("[!] Error: Memory allocation failed\n");
+		return 1;
+	}
+
+	// Same layout as evsets: victims 64KB apart below, the pool above. The
+	// pool size is fixed, so that it does not vary with the swept geometry
+	victims_sz = (((unsigned long)trials << 16) + (2 << 20) - 1) & ~((2UL << 20) - 1);
+	if (pool_open(&mem, victims_sz + pool_sz, NULL, simulate ? POOL_NOHUGE : POOL_POPULATE | POOL_LOCK)) {
+		printf("[!] Error: Memory allocation failed\n");
+		return 1;
+	}
+	buffer = mem.base;
+	pool = &buffer[victims_sz];
+	printf("[+] Pool: %lu MB of %s pages\n", pool_sz >> 20, pool_kind_name(mem.kind));
+
+	if (simulate) {
+		conf.cache_way = ways.v[0];
+		sim_default_config(&sim_conf, &conf);
+		sim_conf.policy = policy;
+		sim_conf.noise = noise;
+	} else {
+		oracle_hw_init(&oracle);
+		conf.oracle = &oracle;
+		if (timer_init(timer_kind, -1)) {
+			printf("[!] Error: could not start %s timer\n", timer_name(timer_kind));
+			return 1;
+		}
+	}
+	threshold_key(key, sizeof(key));
+
+	// Calibrate once per strategy, not once per trial
+	for (e = 0; e < ntraversals; e++) {
+		conf.traversal = traversals[e];
+		thresholds[e] = threshold;
+		if (!simulate && threshold <= 0) {
+			quiet(!verbose);
+			thresholds[e] = oracle_calibrate(conf.oracle, buffer, &conf);
+			quiet(0);
+			if (thresholds[e] < 0) {
+				printf("[!] Error: calibration (%s)\n", traversal_name(traversals[e]));
+				return 1;
+			}
+		}
+	}
+
+	if (json && !(fj = fopen(json, "w"))) {
+		printf("[!] Error: could not write %s\n", json);
+		return 1;
+	}
+	if (csv && !(fc = fopen(csv, "w"))) {
+		printf("[!] Error: could not write %s\n", csv);
+		return 1;
+	}
+	if (fj) {
+		fprintf(fj, "{\n  \"oracle\": \"%s\",\n  \"machine\": ", simulate ? "sim" : "hw");
+		json_string(fj, key);
+		fprintf(fj, ",\n  \"cache_size\": %d,\n  \"slices\": %d,\n  \"seed\": %llu,\n", conf.cache_size,
+			conf.cache_slices, (unsigned long long)seed);
+		if (simulate) {
+			fprintf(fj, "  \"policy\": \"%s\",\n  \"noise\": %f,\n", policies[policy], noise);
+		}
+		fprintf(fj, "  \"trials\": [");
+	}
+	if (fc) {
+		fprintf(fc, "algorithm,strategy,size,rounds,ways,stride,trial,seed,ok,congruent,len,seconds,tests,"
+			    "probes,lines,backtracks,retries\n");
+	}
+
+	printf("[+] Oracle: %s, machine: %s\n", simulate ? "sim" : "hw", key);
+
+	total = nalgorithms * ntraversals * sizes.n * rounds.n * ways.n * strides.n;
+	for (c = 0; c < total; c++) {
+		// Last parameter varies fastest
+		k = c;
+		o = k % strides.n, k /= strides.n;
+		n = k % ways.n, k /= ways.n;
+		r = k % rounds.n, k /= rounds.n;
+		b = k % sizes.n, k /= sizes.n;
+		e = k % ntraversals, k /= ntraversals;
+		a = k;
+
+		struct trial_t t = {
+			.size = sizes.v[b],
+			.rounds = rounds.v[r],
+			.ways = ways.v[n],
+			.stride = strides.v[o],
+			.algorithm = algorithms[a],
+			.traversal = traversals[e],
+		};
+		struct eviction_stats_t sum = { 0 };
+		int ok = 0, good = 0;
+
+		conf.initial_set_size = t.size;
+		conf.rounds = t.rounds;
+		conf.cache_way = t.ways;
+		conf.stride = t.stride;
+		conf.algorithm = t.algorithm;
+		conf.traversal = t.traversal;
+		conf.threshold = thresholds[e];
+		if (t.stride < 64 || (unsigned long)t.size > pool_sz / t.stride) {
+			printf("[!] Error: -b %d does not fit the pool at stride %d, skipped\n", t.size, t.stride);
+			continue;
+		}
+
+		for (i = 0; i < trials; i++) {
+			t.trial = i;
+			t.seed = seed + i;
+			if (!verbose) {
+				quiet(1);
+			}
+			if (run_trial(pool, pool_sz, &buffer[i << 16], conf, simulate ? &sim_conf : NULL, &t)) {
+				quiet(0);
+				printf("[!] Error: invalid simulator geometry for %d ways, skipped\n", t.ways);
+				break;
+			}
+			quiet(0);
+			times[i] = t.seconds;
+			ok += t.ok;
+			good += t.congruent;
+			sum.tests += t.stats.tests;
+			sum.lines += t.stats.lines;
+			sum.backtracks += t.stats.backtracks;
+			sum.retries += t.stats.retries;
+			if (fj) {
+				write_json(fj, &t, first);
+				first = 0;
+			}
+			if (fc) {
+				write_csv(fc, &t);
+			}
+		}
+		if (i < trials) {
+			continue;
+		}
+		configs++;
+
+		qsort(times, trials, sizeof(double), cmp_double);
+		printf("[+] -a %c -e %s -b %d -r %d -n %d -o %d: %d/%d found (%d congruent), median %.4fs, "
+		       "%.0f tests, %.3g lines, %.2f backtracks, %.2f retries per trial\n",
+		       t.algorithm, traversal_name(t.traversal), t.size, t.rounds, t.ways, t.stride, ok, trials, good,
+		       times[trials / 2], (double)sum.tests / trials, (double)sum.lines / trials,
+		       (double)sum.backtracks / trials, (double)sum.retries / trials);
+	}
+
+	if (fj) {
+		fprintf(fj, "\n  ]\n}\n");
+		fclose(fj);
+	}
+	if (fc) {
+		fclose(fc);
+	}
+	printf("[+] %d configurations x %d trials\n", configs, trials);
+
+	free(times);
+	timer_stop();
+	pool_close(&mem);
+	return 0;
+}
@@ -1,251 +1,401 @@
 #include "cache.h"
 #include "eviction.h"
+#include "hist.h"
+#include "threshold.h"
+#include "timer.h"
+#include "traversal.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 
 #define LINE_BITS 6
 #define PAGE_BITS 12
 #define LINE_SIZE (1 << LINE_BITS)
 #define PAGE_SIZE2 (1 << PAGE_BITS)
 
+#define CAL_BATCH 1000
+#define CAL_CHECK_ROUNDS 1000
+#define CAL_SCRATCH_LINES 64
+
 typedef unsigned long long int ul;
 
-struct histogram {
-	int val;
-	int count;
-};
+inline void
+flush(void *p)
+{
+	__asm__ volatile("clflush 0(%0)" : : "c"(p) : "rax");
+}
 
-void
-hist_add(struct histogram *hist, int len, size_t val)
-{
-	// remove outliers
-	int j = val;
-	if (j < 800) // remove outliers
-	{
-		while (hist[j % len].val > 0 && hist[j % len].val != (int)val) {
-			j++;
-		}
-		hist[j % len].val = val;
-		hist[j % len].count++;
-	}
+inline void
+maccess(void *p)
+{
+	__asm__ volatile("movq (%0), %%rax\n" : : "c"(p) : "rax");
 }
 
-float
-hist_avg(struct histogram *hist, int len)
+inline void
+traverse_list_simple(cache_block_t *set)
 {
-	float total = 0;
-	int i = 0, n = 0;
-	for (i = 0; i < len; i++) {
-		if (hist[i].val > 0) {
-			total += hist[i].val * hist[i].count;
-			n += hist[i].count;
-		}
+	while (set) {
+		maccess(set);
+		set = set->next;
 	}
-	return (float)(total / n);
 }
 
-int
-hist_mode(struct histogram *hist, int len)
+static void
+access_line(void *ctx, void *p)
 {
-	int i, max = 0, mode = 0;
-	for (i = 0; i < len; i++) {
-		if (hist[i].count > max) {
-			max = hist[i].count;
-			mode = hist[i].val;
-		}
-	}
-	return mode;
+	(void)ctx;
+	maccess(p);
 }
 
-int
-hist_min(struct histogram *hist, int len)
+/**
+ * Traverses set with strategy t, or once forward if t is NULL.
+ */
+void
+traverse_list(cache_block_t *set, const struct traversal_t *t)
 {
-	int i, min = 99999;
-	for (i = 0; i < len; i++) {
-		if (hist[i].count > 0 && hist[i].val < min) {
-			min = hist[i].val;
-		}
+	if (!t) {
+		traverse_list_simple(set);
+	} else {
+		traverse_pattern(set, t, access_line, NULL);
 	}
-	return min;
 }
 
 int
-hist_max(struct histogram *hist, int len)
+test_set(cache_block_t *set, char *victim, const struct traversal_t *t)
 {
-	int i, max = 0;
-	for (i = 0; i < len; i++) {
-		if (hist[i].count > 0 && hist[i].val > max) {
-			max = hist[i].val;
-		}
-	}
-	return max;
+	maccess(victim);
+	maccess(victim);
+	maccess(victim);
+	maccess(victim);
+
+	traverse_list(set, t);
+
+	maccess(victim + 222); // page walk
+
+	size_t delta, time;
+	time = timer_now();
+	maccess(victim);
+	delta = timer_now() - time;
+	return delta;
 }
 
-double
-hist_variance(struct histogram *hist, int len, int mean)
+/**
+ * Like test_set for n victims at once: all victims are loaded, the set is
+ * traversed once, then each victim is timed.
+ *
+ * @param lat receives the access latency of each victim
+ */
+void
+test_set_batch(cache_block_t *set, char **victims, int n, int *lat, const struct traversal_t *t)
 {
-	int i, count = 0;
-	double sum = 0;
-	for (i = 0; i < len; i++) {
-		if (hist[i].count > 0) {
-			sum += pow((double)(hist[i].val - mean), 2.0) * hist[i].count;
-			count += hist[i].count;
-		}
+	int i;
+	size_t time;
+
+	for (i = 0; i < n; i++) {
+		maccess(victims[i]);
+		maccess(victims[i]);
 	}
-	return sum / count;
-}
 
-double
-hist_std(struct histogram *hist, int len, int mean)
-{
-	return sqrt(hist_variance(hist, len, mean));
+	traverse_list(set, t);
+
+	for (i = 0; i < n; i++) {
+		maccess(victims[i] + 222); // page walk
+	}
+
+	for (i = 0; i < n; i++) {
+		time = timer_now();
+		maccess(victims[i]);
+		lat[i] = timer_now() - time;
+	}
 }
 
-// count number of misses
+/**
+ * 
+ * @return 1 if average delta exceeds threshold, indicating performance issue; otherwise, 0.
+*/
 int
-hist_q(struct histogram *hist, int len, int threshold)
+tests_avg(cache_block_t *set, char *victim, int rep, int threshold, const struct traversal_t *t)
 {
-	int i = 0, count = 0;
-	for (i = 0; i < len; i++) {
-		if (hist[i].count > 0 && hist[i].val > threshold) {
-			count += hist[i].count;
+	int i = 0, avg = 0, delta = 0, n = 0;
+	cache_block_t *vic = (cache_block_t *)victim;
+	vic->delta = 0;
+	for (i = 0; i < rep; i++) {
+		delta = test_set(set, victim, t);
+		if (delta < 800) {
+			// Otherwise, we probably have a noisy measurement
+			vic->delta += delta;
+			n++;
 		}
 	}
-	return count;
+	// Average over kept samples only, dropped outliers must not pull it down
+	avg = n ? (float)vic->delta / n : 0;
+	return avg > threshold;
 }
 
-inline void
-flush(void *p)
+void
+sprt_init(struct sprt_t *s, double error)
 {
-	__asm__ volatile("clflush 0(%0)" : : "c"(p) : "rax");
+	s->llr = 0;
+	s->upper = log((1 - error) / error);
+	s->lower = log(error / (1 - error));
+	s->step_miss = log(SPRT_P_EVICT / SPRT_P_KEEP);
+	s->step_hit = log((1 - SPRT_P_EVICT) / (1 - SPRT_P_KEEP));
 }
 
-inline uint64_t
-rdtscfence()
+/**
+ * Adds one hit/miss outcome to the log-likelihood ratio.
+ *
+ * @return 1 if eviction is accepted, 0 if rejected, -1 if more samples are needed.
+ */
+int
+sprt_add(struct sprt_t *s, int miss)
 {
-	uint64_t a, d;
-	__asm__ volatile("lfence");
-	__asm__ volatile("rdtsc" : "=a"(a), "=d"(d) : :);
-	__asm__ volatile("lfence");
-	return ((d << 32) | a);
+	s->llr += miss ? s->step_miss : s->step_hit;
+	if (s->llr >= s->upper) {
+		return 1;
+	}
+	if (s->llr <= s->lower) {
+		return 0;
+	}
+	return -1;
 }
 
-inline void
-maccess(void *p)
+/**
+ * Like tests_avg, but stops as soon as a sequential probability ratio test
+ * decides with the given error rate. Falls back to the average of kept
+ * samples if still undecided after rep samples.
+ *
+ * @param used If not NULL, receives the number of measurements taken.
+ * @return 1 if the victim is evicted, otherwise 0.
+ */
+int
+tests_sprt(cache_block_t *set, char *victim, int rep, int threshold, double error, int *used,
+	   const struct traversal_t *t)
 {
-	__asm__ volatile("movq (%0), %%rax\n" : : "c"(p) : "rax");
-}
+	int i = 0, delta = 0, n = 0, ret = -1;
+	size_t total = 0;
+	struct sprt_t s;
 
-inline void
-traverse_list_simple(cache_block_t *set)
-{
-	while (set) {
-		maccess(set);
-		set = set->next;
+	sprt_init(&s, error);
+	for (i = 0; i < rep && ret < 0; i++) {
+		delta = test_set(set, victim, t);
+		if (delta < 800) {
+			total += delta;
+			n++;
+			ret = sprt_add(&s, delta > threshold);
+		}
+	}
+	if (used) {
+		*used = i;
+	}
+	if (ret < 0) {
+		ret = n ? (int)((float)total / n) > threshold : 0;
 	}
+	return ret;
 }
 
-int
-test_set(cache_block_t *set, char *victim)
+/*
+ * Calibration samples run the strategy over a scratch list of lines in
+ * other cache sets (when one is given), so that hits and misses are timed
+ * in the same state as after a test traversal.
+ */
+static size_t
+sample_unflushed(char *victim, cache_block_t *scratch, const struct traversal_t *t)
 {
+	size_t time;
+
 	maccess(victim);
 	maccess(victim);
 	maccess(victim);
 	maccess(victim);
 
-	traverse_list_simple(set);
+	if (scratch) {
+		traverse_list(scratch, t);
+	}
 
 	maccess(victim + 222); // page walk
 
-	size_t delta, time;
-	time = rdtscfence();
+	time = timer_now();
 	maccess(victim);
-	delta = rdtscfence() - time;
-	return delta;
+	return timer_now() - time;
+}
+
+static size_t
+sample_flushed(char *victim, cache_block_t *scratch, const struct traversal_t *t)
+{
+	size_t time;
+
+	maccess(victim); // page walk
+	if (scratch) {
+		traverse_list(scratch, t);
+	}
+	flush(victim);
+
+	time = timer_now();
+	maccess(victim);
+	return timer_now() - time;
+}
+
+/*
+ * Upper bound on the misclassification rate (rule of three), so that a
+ * handful of clean samples is not mistaken for a separated distribution.
+ */
+static int
+separated(int errors, uint64_t n, double confidence)
+{
+	return n > 0 && (double)(errors + 3) / n <= 1 - confidence;
+}
+
+static int
+threshold_of(struct histogram_t *flushed, struct histogram_t *unflushed)
+{
+	return (hist_avg(flushed) + hist_avg(unflushed) * 2) / 3;
 }
 
 /**
- * 
- * @return 1 if average delta exceeds threshold, indicating performance issue; otherwise, 0.
-*/
+ * Cheap drift test for a cached threshold.
+ *
+ * @return 1 if hits and misses are still separated by threshold, otherwise 0.
+ */
 int
-tests_avg(cache_block_t *set, char *victim, int rep, int threshold)
+calibrate_check(char *victim, int threshold, double confidence, cache_block_t *scratch,
+		const struct traversal_t *t)
 {
-	int i = 0, avg = 0, delta = 0;
-	cache_block_t *vic = (cache_block_t *)victim;
-	vic->delta = 0;
-	for (i = 0; i < rep; i++) {
-		delta = test_set(set, victim);
-		if (delta < 800) {
-			// Otherwise, we probably have a noisy measurement
-			vic->delta += delta;
-		}
+	int i, hits = 0, misses = 0;
+
+	for (i = 0; i < CAL_CHECK_ROUNDS; i++) {
+		hits += sample_unflushed(victim, scratch, t) > (size_t)threshold;
+		misses += sample_flushed(victim, scratch, t) <= (size_t)threshold;
 	}
-	avg = (float)vic->delta / rep;
-	return avg > threshold;
+	return separated(hits, CAL_CHECK_ROUNDS, confidence) && separated(misses, CAL_CHECK_ROUNDS, confidence);
 }
 
-int
-calibrate(char *victim, struct eviction_config_t *conf)
+static int
+calibrate_rounds(char *victim, struct eviction_config_t *conf, cache_block_t *scratch)
 {
-	size_t delta, time, t_flushed, t_unflushed;
-	struct histogram *flushed, *unflushed;
-	int i, ret, hsz = conf->cal_rounds * 100;
+	size_t t_flushed, t_unflushed;
+	struct histogram_t *flushed, *unflushed;
+	int i, ret, rounds = 0;
 
-	flushed = (struct histogram *)calloc(hsz, sizeof(struct histogram));
-	unflushed = (struct histogram *)calloc(hsz, sizeof(struct histogram));
+	flushed = (struct histogram_t *)malloc(sizeof(struct histogram_t));
+	unflushed = (struct histogram_t *)malloc(sizeof(struct histogram_t));
 
 	if (flushed == NULL || unflushed == NULL) {
+		free(flushed);
+		free(unflushed);
 		return -1;
 	}
+	hist_init(flushed);
+	hist_init(unflushed);
+
+	// Sample in batches, stop once the distributions are told apart
+	while (rounds < conf->cal_rounds) {
+		int batch = conf->cal_confidence > 0 ? CAL_BATCH : conf->cal_rounds;
+		if (batch > conf->cal_rounds - rounds) {
+			batch = conf->cal_rounds - rounds;
+		}
+		for (i = 0; i < batch; i++) {
+			hist_add(unflushed, sample_unflushed(victim, scratch, conf->traversal));
+		}
+		for (i = 0; i < batch; i++) {
+			hist_add(flushed, sample_flushed(victim, scratch, conf->traversal));
+		}
+		rounds += batch;
+
+		if (conf->cal_confidence > 0) {
+			int t = threshold_of(flushed, unflushed);
+			int hits = hist_q(unflushed, t);
+			int misses = flushed->n - hist_q(flushed, t);
+			if (separated(hits, unflushed->n, conf->cal_confidence) &&
+			    separated(misses, flushed->n, conf->cal_confidence)) {
+				break;
+			}
+		}
+	}
+	t_unflushed = hist_avg(unflushed);
+	t_flushed = hist_avg(flushed);
 
-	for (i = 0; i < conf->cal_rounds; i++) {
-		maccess(victim);
-		maccess(victim);
-		maccess(victim);
-		maccess(victim);
+	ret = hist_min(flushed);
 
-		maccess(victim + 222); // page walk
+	printf("\tflushed: min %d, mode %d, avg %f, max %d, std %.02f, q %d (%.02f)\n", hist_min(flushed),
+	       hist_mode(flushed), hist_avg(flushed), hist_max(flushed), hist_std(flushed),
+	       hist_q(flushed, ret), (double)hist_q(flushed, ret) / rounds);
+	printf("\tunflushed: min %d, mode %d, avg %f, max %d, std %.02f, q %d (%.02f)\n", hist_min(unflushed),
+	       hist_mode(unflushed), hist_avg(unflushed), hist_max(unflushed), hist_std(unflushed),
+	       hist_q(unflushed, ret), (double)hist_q(unflushed, ret) / rounds);
+	printf("\trounds: %d/%d\n", rounds, conf->cal_rounds);
 
-		time = rdtscfence();
-		maccess(victim);
-		delta = rdtscfence() - time;
-		hist_add(unflushed, hsz, delta);
+	free(unflushed);
+	free(flushed);
+
+	if (t_flushed <= t_unflushed) {
+		return -1;
+	} else {
+		return (t_flushed + t_unflushed * 2) / 3;
 	}
-	t_unflushed = hist_avg(unflushed, hsz);
+}
 
-	for (i = 0; i < conf->cal_rounds; i++) {
-		maccess(victim); // page walk
-		flush(victim);
+/**
+ * Calibrates the hit/miss threshold. With conf->cal_cache set, a threshold
+ * cached for this CPU model, governor and core is reused as long as a short
+ * spot check still separates hits from misses. With conf->traversal set,
+ * samples are taken after running that strategy over a scratch list, and
+ * the threshold is cached per strategy parameters.
+ *
+ * @return threshold in cycles, or -1 on failure.
+ */
+int
+calibrate(char *victim, struct eviction_config_t *conf)
+{
+	char key[256];
+	int i, threshold = 0;
+	double confidence = conf->cal_confidence > 0 ? conf->cal_confidence : 0.99;
+	cache_block_t *scratch = NULL;
 
-		time = rdtscfence();
-		maccess(victim);
-		delta = rdtscfence() - time;
-		hist_add(flushed, hsz, delta);
+	// The counting thread must be running before the first sample
+	if (timer_kind == TIMER_COUNTER && timer_init(TIMER_COUNTER, -1)) {
+		return -1;
 	}
-	t_flushed = hist_avg(flushed, hsz);
 
-	ret = hist_min(flushed, hsz);
+	// One line per set index of a page, too few per set to evict the victim
+	if (conf->traversal) {
+		scratch = (cache_block_t *)aligned_alloc(PAGE_SIZE2, CAL_SCRATCH_LINES * LINE_SIZE);
+		if (!scratch) {
+			return -1;
+		}
+		for (i = 0; i < CAL_SCRATCH_LINES; i++) {
+			scratch[i].next = i + 1 < CAL_SCRATCH_LINES ? &scratch[i + 1] : NULL;
+			scratch[i].prev = i > 0 ? &scratch[i - 1] : NULL;
+		}
+	}
 
-	printf("\tflushed: min %d, mode %d, avg %f, max %d, std %.02f, q %d (%.02f)\n",
-	       hist_min(flushed, hsz), hist_mode(flushed, hsz), hist_avg(flushed, hsz),
-	       hist_max(flushed, hsz), hist_std(flushed, hsz, hist_avg(flushed, hsz)),
-	       hist_q(flushed, hsz, ret), (double)hist_q(flushed, hsz, ret) / conf->cal_rounds);
-	printf("\tunflushed: min %d, mode %d, avg %f, max %d, std %.02f, q %d (%.02f)\n",
-	       hist_min(unflushed, hsz), hist_mode(unflushed, hsz), hist_avg(unflushed, hsz),
-	       hist_max(unflushed, hsz), hist_std(unflushed, hsz, hist_avg(unflushed, hsz)),
-	       hist_q(unflushed, hsz, ret), (double)hist_q(unflushed, hsz, ret) / conf->cal_rounds);
+	if (conf->cal_cache) {
+		threshold_key(key, sizeof(key));
+		if (conf->traversal) {
+			// As in -e: custom strategies share a name, not their parameters
+			const struct traversal_t *t = conf->traversal;
+			size_t len = strlen(key);
+			snprintf(key + len, sizeof(key) - len, ";%d,%d,%d,%d", t->repeat, t->window, t->step, t->back);
+		}
+		if (!threshold_load(conf->cal_cache, key, &threshold)) {
+			if (calibrate_check(victim, threshold, confidence, scratch, conf->traversal)) {
+				printf("\tcached: %d (%s)\n", threshold, key);
+				free(scratch);
+				return threshold;
+			}
+			printf("\tcached: %d drifted, recalibrating\n", threshold);
+		}
+	}
 
-	free(unflushed);
-	free(flushed);
+	threshold = calibrate_rounds(victim, conf, scratch);
+	free(scratch);
 
-	if (t_flushed < t_unflushed) {
-		return -1;
-	} else {
-		return (t_flushed + t_unflushed * 2) / 3;
+	if (conf->cal_cache && threshold > 0 && threshold_save(conf->cal_cache, key, threshold)) {
+		printf("[!] Error: could not write %s\n", conf->cal_cache);
 	}
+	return threshold;
 }
@@ -5,11 +5,33 @@
 #include <stdint.h>
 
 #include "eviction.h"
+#include "traversal.h"
 
 void traverse_list_simple(cache_block_t *ptr);
+void traverse_list(cache_block_t *set, const struct traversal_t *t);
 
-int tests_avg(cache_block_t *ptr, char *victim, int rep, int threshold);
+int test_set(cache_block_t *set, char *victim, const struct traversal_t *t);
+void test_set_batch(cache_block_t *set, char **victims, int n, int *lat, const struct traversal_t *t);
+
+int tests_avg(cache_block_t *ptr, char *victim, int rep, int threshold, const struct traversal_t *t);
+
+// Miss probability per sample when the set does / does not evict the victim
+#define SPRT_P_EVICT 0.9
+#define SPRT_P_KEEP 0.1
+
+struct sprt_t {
+	double llr;
+	double upper, lower;
+	double step_miss, step_hit;
+};
+
+void sprt_init(struct sprt_t *s, double error);
+int sprt_add(struct sprt_t *s, int miss);
+int tests_sprt(cache_block_t *set, char *victim, int rep, int threshold, double error, int *used,
+	       const struct traversal_t *t);
 
 int calibrate(char *victim, struct eviction_config_t *conf);
+int calibrate_check(char *victim, int threshold, double confidence, cache_block_t *scratch,
+		    const struct traversal_t *t);
 
 #endif /* cache_H */
@@ -0,0 +1,178 @@
+#include "classify.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CLASSIFY_BLOCK 256
+
+// according to Maurice et al.
+static const uint64_t maurice[] = { 0x1b5f575440ULL, 0x2eb5faa880ULL, 0x3cccc93100ULL };
+
+static int
+hash_bits(int slices)
+{
+	int bits = 0;
+	while ((1 << bits) < slices) {
+		bits++;
+	}
+	return bits;
+}
+
+/**
+ * @return 0 on success, -1 if nmasks cannot tell slices apart or sets is
+ * not a power of two.
+ */
+int
+slice_fn_init(struct slice_fn_t *f, const uint64_t *masks, int nmasks, int slices, int sets)
+{
+	int i;
+
+	if (slices < 1 || nmasks < hash_bits(slices) || nmasks > CLASSIFY_MAX_MASKS || sets < 1 ||
+	    (sets & (sets - 1))) {
+		return -1;
+	}
+	memset(f, 0, sizeof(*f));
+	memcpy(f->masks, masks, nmasks * sizeof(uint64_t));
+	f->nmasks = nmasks;
+	f->slices = slices;
+	f->sets = sets;
+	if (slices & (slices - 1)) {
+		return 0;
+	}
+	for (i = 0; i < (1 << nmasks); i++) {
+		f->table[i] = i & (slices - 1);
+	}
+	f->has_table = 1;
+	return 0;
+}
+
+/**
+ * Published masks, for power of two slice counts up to 8.
+ *
+ * @return -1 for other slice counts, whose lookup table is not known.
+ */
+int
+slice_fn_default(struct slice_fn_t *f, int slices, int sets)
+{
+	int bits = hash_bits(slices);
+	if ((slices & (slices - 1)) || bits > (int)(sizeof(maurice) / sizeof(maurice[0]))) {
+		return -1;
+	}
+	return slice_fn_init(f, maurice, bits, slices, sets);
+}
+
+// table[h] is the slice of hash value h, for all 2^nmasks values
+int
+slice_fn_set_table(struct slice_fn_t *f, const uint16_t *table, int len)
+{
+	int i;
+
+	if (len != 1 << f->nmasks) {
+		return -1;
+	}
+	for (i = 0; i < len; i++) {
+		if (table[i] >= f->slices) {
+			return -1;
+		}
+	}
+	memcpy(f->table, table, len * sizeof(uint16_t));
+	f->has_table = 1;
+	return 0;
+}
+
+static inline uint64_t
+parity(uint64_t x)
+{
+	// Shifts only, so that the loops below vectorize without a vector popcount
+	x ^= x >> 32;
+	x ^= x >> 16;
+	x ^= x >> 8;
+	x ^= x >> 4;
+	x ^= x >> 2;
+	x ^= x >> 1;
+	return x & 1;
+}
+
+// -1 if f has no table
+int
+classify_slice(const struct slice_fn_t *f, uint64_t paddr)
+{
+	int i, h = 0;
+	if (!f->has_table) {
+		return -1;
+	}
+	for (i = 0; i < f->nmasks; i++) {
+		h |= __builtin_parityll(f->masks[i] & paddr) << i;
+	}
+	return f->table[h];
+}
+
+/*
+ * Hash values of n <= CLASSIFY_BLOCK addresses, one mask at a time over the
+ * whole block. Inlined twice: for AVX2 (four addresses per instruction) and
+ * for the baseline ISA, picked at run time.
+ */
+static inline __attribute__((always_inline)) void
+hash_block(const struct slice_fn_t *f, const uint64_t *paddrs, int n, uint64_t *h)
+{
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		h[i] = 0;
+	}
+	for (k = 0; k < f->nmasks; k++) {
+		uint64_t m = f->masks[k];
+		for (i = 0; i < n; i++) {
+			h[i] |= parity(paddrs[i] & m) << k;
+		}
+	}
+}
+
+__attribute__((target("avx2"))) static void
+hash_block_avx2(const struct slice_fn_t *f, const uint64_t *paddrs, int n, uint64_t *h)
+{
+	hash_block(f, paddrs, n, h);
+}
+
+static void
+hash_block_scalar(const struct slice_fn_t *f, const uint64_t *paddrs, int n, uint64_t *h)
+{
+	hash_block(f, paddrs, n, h);
+}
+
+/**
+ * Classifies n physical addresses into their set index (within the slice)
+ * and slice. Either output may be NULL; slices must be NULL if f has no
+ * table.
+ */
+void
+classify_bulk(const struct slice_fn_t *f, const uint64_t *paddrs, int n, uint32_t *sets, uint16_t *slices)
+{
+	static int avx2 = -1;
+	uint64_t h[CLASSIFY_BLOCK];
+	int i, j, len;
+
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2");
+	}
+
+	for (i = 0; i < n; i += CLASSIFY_BLOCK) {
+		len = n - i < CLASSIFY_BLOCK ? n - i : CLASSIFY_BLOCK;
+		if (slices) {
+			if (avx2) {
+				hash_block_avx2(f, paddrs + i, len, h);
+			} else {
+				hash_block_scalar(f, paddrs + i, len, h);
+			}
+			for (j = 0; j < len; j++) {
+				slices[i + j] = f->table[h[j]];
+			}
+		}
+		if (sets) {
+			for (j = 0; j < len; j++) {
+				sets[i + j] = (paddrs[i + j] >> 6) & (f->sets - 1);
+			}
+		}
+	}
+}
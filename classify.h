@@ -0,0 +1,32 @@
+#ifndef classify_H
+#define classify_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CLASSIFY_MAX_MASKS 8
+
+/*
+ * Physical address to (set, slice). Bit i of the hash is the parity of
+ * masks[i] over the address. With a power of two slice count the hash is
+ * the slice; otherwise (6, 10, 12, 14 slices...) the hash is not linear and
+ * indexes table, which must be installed with slice_fn_set_table. Until it
+ * is, no slice can be told (has_table is 0).
+ */
+struct slice_fn_t {
+	uint64_t masks[CLASSIFY_MAX_MASKS];
+	int nmasks;
+	int slices;
+	int sets; // per slice, power of two
+	int has_table;
+	uint16_t table[1 << CLASSIFY_MAX_MASKS];
+};
+
+int slice_fn_init(struct slice_fn_t *f, const uint64_t *masks, int nmasks, int slices, int sets);
+int slice_fn_default(struct slice_fn_t *f, int slices, int sets);
+int slice_fn_set_table(struct slice_fn_t *f, const uint16_t *table, int len);
+
+int classify_slice(const struct slice_fn_t *f, uint64_t paddr);
+void classify_bulk(const struct slice_fn_t *f, const uint64_t *paddrs, int n, uint32_t *sets, uint16_t *slices);
+
+#endif /* classify_H */
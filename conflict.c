@@ -0,0 +1,105 @@
+#include "conflict.h"
+#include "list_utils.h"
+#include "oracle.h"
+#include "reduction.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void
+append(cache_block_t **head, cache_block_t **tail, cache_block_t *x)
+{
+	x->next = NULL;
+	x->prev = *tail;
+	if (*tail) {
+		(*tail)->next = x;
+	} else {
+		*head = x;
+	}
+	*tail = x;
+}
+
+/**
+ * Computes the conflict set of a candidate list: one minimal eviction set for
+ * every cache set that has more than cache_way lines in the list.
+ *
+ * First every line that is not evicted by the lines kept so far is kept; each
+ * cache set then holds at most cache_way kept lines, and every dropped line is
+ * evicted by the kept lines congruent with it. Then, for each dropped line not
+ * yet evicted by the conflict set, its eviction set is reduced out of the kept
+ * lines not yet assigned.
+ *
+ * @param set in: candidate list, out: conflict set
+ * @param rest out: the other lines of the candidate list are appended here
+ * @return number of minimal eviction sets in the conflict set.
+ */
+int
+conflict_set_build(cache_block_t **set, cache_block_t **rest, struct eviction_config_t *conf)
+{
+	cache_block_t *kept = NULL, *kept_tail = NULL;
+	cache_block_t *dropped = NULL, *dropped_tail = NULL;
+	cache_block_t *out = NULL, *out_tail = NULL;
+	cache_block_t *cs = NULL, *x = *set, *next;
+	int found = 0, nkept = 0;
+
+	while (x) {
+		next = x->next;
+		if (oracle_test_len(conf, kept, nkept, (char *)x)) {
+			append(&dropped, &dropped_tail, x);
+		} else {
+			append(&kept, &kept_tail, x);
+			nkept++;
+		}
+		x = next;
+	}
+
+	for (x = dropped; x; x = next) {
+		cache_block_t *es = kept, *can = NULL;
+		next = x->next;
+		x->next = x->prev = NULL;
+
+		if (oracle_test(conf, cs, (char *)x) || !oracle_test(conf, kept, (char *)x)) {
+			// Already covered, or lost to noise
+			append(&out, &out_tail, x);
+			continue;
+		}
+		if (reduce_eviction_set(&es, &can, (char *)x, conf)) {
+			list_concat(&es, can);
+			kept = es;
+		} else {
+			list_concat(&cs, es);
+			kept = can;
+			found++;
+		}
+		append(&out, &out_tail, x);
+	}
+
+	list_concat(&out, kept);
+	list_concat(rest, out);
+	*set = cs;
+	return found;
+}
+
+/**
+ * Carves a minimal eviction set for victim out of a conflict set, without
+ * going back to the pool. The lines used are removed from the conflict set.
+ *
+ * @return 0 on success, 1 if the conflict set holds no eviction set for victim.
+ */
+int
+conflict_set_carve(cache_block_t **cs, char *victim, cache_block_t **eviction_set, struct eviction_config_t *conf)
+{
+	cache_block_t *es = *cs, *can = NULL;
+
+	if (!oracle_test(conf, es, victim)) {
+		return 1;
+	}
+	if (reduce_eviction_set(&es, &can, victim, conf)) {
+		list_concat(&es, can);
+		*cs = es;
+		return 1;
+	}
+	*cs = can;
+	*eviction_set = es;
+	return 0;
+}
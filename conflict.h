@@ -0,0 +1,12 @@
+#ifndef conflict_H
+#define conflict_H
+
+#include <stdlib.h>
+
+#include "eviction.h"
+
+int conflict_set_build(cache_block_t **set, cache_block_t **rest, struct eviction_config_t *conf);
+int conflict_set_carve(cache_block_t **cs, char *victim, cache_block_t **eviction_set,
+		       struct eviction_config_t *conf);
+
+#endif /* conflict_H */
@@ -0,0 +1,116 @@
+#include "cset.h"
+
+#include <stdlib.h>
+
+int
+cset_init(struct cset_t *c, int cap)
+{
+	c->lines = (cache_block_t **)calloc(cap, sizeof(cache_block_t *));
+	c->len = 0;
+	c->size = 0;
+	c->cap = cap;
+	return c->lines == NULL;
+}
+
+void
+cset_free(struct cset_t *c)
+{
+	free(c->lines);
+	c->lines = NULL;
+	c->len = c->size = c->cap = 0;
+}
+
+/**
+ * Loads a list as the active lines, dropping any removed ones.
+ *
+ * @return 0 on success, 1 if the list does not fit.
+ */
+int
+cset_from_list(struct cset_t *c, cache_block_t *ptr)
+{
+	int n = 0;
+	while (ptr) {
+		if (n == c->cap) {
+			return 1;
+		}
+		c->lines[n++] = ptr;
+		ptr = ptr->next;
+	}
+	c->len = c->size = n;
+	return 0;
+}
+
+/**
+ * Links lines [from, to) except [skip_from, skip_to) into a list.
+ *
+ * @return head of the list, NULL if empty.
+ */
+cache_block_t *
+cset_link(struct cset_t *c, int from, int to, int skip_from, int skip_to)
+{
+	cache_block_t *head = NULL, *tail = NULL;
+	int i;
+
+	for (i = from; i < to; i++) {
+		if (i == skip_from) {
+			i = skip_to - 1;
+			continue;
+		}
+		if (tail) {
+			tail->next = c->lines[i];
+		} else {
+			head = c->lines[i];
+		}
+		c->lines[i]->prev = tail;
+		tail = c->lines[i];
+	}
+	if (tail) {
+		tail->next = NULL;
+	}
+	return head;
+}
+
+static void
+reverse(cache_block_t **lines, int from, int to)
+{
+	cache_block_t *tmp;
+	while (from < --to) {
+		tmp = lines[from];
+		lines[from++] = lines[to];
+		lines[to] = tmp;
+	}
+}
+
+/*
+ * Moves active lines [from, to) to the top of the removed stack by swapping
+ * them with the last active lines. Order inside the active set is irrelevant.
+ */
+void
+cset_remove(struct cset_t *c, int from, int to)
+{
+	int n = to - from, tail = c->len - n, i;
+	cache_block_t *tmp;
+
+	if (to > tail && to != c->len) {
+		// Overlaps the tail, rotate instead
+		reverse(c->lines, from, to);
+		reverse(c->lines, to, c->len);
+		reverse(c->lines, from, c->len);
+	} else if (to != c->len) {
+		for (i = 0; i < n; i++) {
+			tmp = c->lines[from + i];
+			c->lines[from + i] = c->lines[tail + i];
+			c->lines[tail + i] = tmp;
+		}
+	}
+	c->len -= n;
+}
+
+// Same split as list_split: n - 1 chunks of len / n lines, the last one gets the rest
+void
+cset_chunk(int len, int n, int i, int *from, int *to)
+{
+	int k = len / n;
+	*from = i * k;
+	*to = (i == n - 1) ? len : *from + k;
+}
@@ -0,0 +1,30 @@
+#ifndef cset_H
+#define cset_H
+
+#include <stdlib.h>
+
+#include "eviction.h"
+
+/*
+ * Candidate set kept as a contiguous array of line pointers. Lines [0, len)
+ * are active; removed chunks are stacked right after them, most recent first,
+ * so undoing a removal only grows len back. Chunks are index ranges, and the
+ * pointer-chase chain is only built for the traversal being measured.
+ */
+struct cset_t {
+	cache_block_t **lines;
+	int len; // active lines
+	int size; // active + removed lines
+	int cap;
+};
+
+int cset_init(struct cset_t *c, int cap);
+void cset_free(struct cset_t *c);
+
+int cset_from_list(struct cset_t *c, cache_block_t *ptr);
+cache_block_t *cset_link(struct cset_t *c, int from, int to, int skip_from, int skip_to);
+void cset_remove(struct cset_t *c, int from, int to);
+
+void cset_chunk(int len, int n, int i, int *from, int *to);
+
+#endif /* cset_H */
@@ -0,0 +1,396 @@
+#include "ctx.h"
+#include "conflict.h"
+#include "list_utils.h"
+#include "oracle.h"
+#include "pool.h"
+#include "reduction.h"
+#include "rng.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CTX_MAX_REPS 50
+#define CTX_PAGE_SIZE 4096
+
+struct evsets_ctx {
+	char *pool;
+	unsigned long pool_sz;
+	struct pool_t mem; // own mapping, if ctx_create was given no pool
+	unsigned long blocks; // lines at conf.stride
+	unsigned long free; // lines with set == -2
+	struct eviction_config_t conf;
+	struct eviction_scratch_t scratch;
+	struct rng_t rng;
+	cache_block_t *cs; // with conf.conflict_set: conflict set, carved by every ctx_find
+};
+
+static cache_block_t *
+block(struct evsets_ctx *ctx, unsigned long i)
+{
+	return (cache_block_t *)&ctx->pool[i * ctx->conf.stride];
+}
+
+// Lines at the stride are the ones counted in ctx->free
+static int
+counted(struct evsets_ctx *ctx, cache_block_t *x)
+{
+	unsigned long off = (char *)x - ctx->pool;
+	return off < ctx->blocks * ctx->conf.stride && off % ctx->conf.stride == 0;
+}
+
+static void
+put(struct evsets_ctx *ctx, cache_block_t *set)
+{
+	cache_block_t *next;
+	while (set) {
+		next = set->next;
+		set->set = -2;
+		set->next = set->prev = NULL;
+		ctx->free += counted(ctx, set);
+		set = next;
+	}
+}
+
+/**
+ * Takes n free lines of the pool at random and links them, at offset bytes
+ * into each stride (0 for the lines searches pick from).
+ *
+ * @return the list, or NULL if fewer than n lines are free.
+ */
+static cache_block_t *
+take(struct evsets_ctx *ctx, unsigned long n, unsigned long offset)
+{
+	cache_block_t *head = NULL, *tail = NULL, *x;
+	unsigned long i, tries = 4 * n, taken = 0;
+
+	if (n == 0 || (!offset && n > ctx->free) || offset >= (unsigned long)ctx->conf.stride) {
+		return NULL;
+	}
+	// Random probes while the pool is mostly free, then a sweep
+	for (i = 0; taken < n && i < tries + ctx->blocks; i++) {
+		if (i < tries) {
+			x = block(ctx, rng_below(&ctx->rng, ctx->blocks));
+		} else {
+			x = block(ctx, (i - tries) % ctx->blocks);
+		}
+		x = (cache_block_t *)((char *)x + offset);
+		if (x->set != -2) {
+			continue;
+		}
+		x->set = -1;
+		x->prev = tail;
+		x->next = NULL;
+		if (tail) {
+			tail->next = x;
+		} else {
+			head = x;
+		}
+		tail = x;
+		taken++;
+	}
+	if (!offset) {
+		ctx->free -= taken;
+	}
+	if (taken < n) {
+		put(ctx, head);
+		return NULL;
+	}
+	return head;
+}
+
+// Marks x in use if it is a free line of the pool
+static int
+claim(struct evsets_ctx *ctx, cache_block_t *x)
+{
+	if ((char *)x < ctx->pool || (char *)x >= ctx->pool + ctx->pool_sz || x->set != -2) {
+		return -1;
+	}
+	x->set = -1;
+	ctx->free -= counted(ctx, x);
+	return 0;
+}
+
+/**
+ * Creates a context over pool, or over a fresh mapping of pool_sz bytes
+ * (see pool.h) if pool is NULL. The threshold is calibrated once here unless conf.threshold
+ * is set.
+ *
+ * @return the context, or NULL on failure.
+ */
+struct evsets_ctx *
+ctx_create(char *pool, unsigned long pool_sz, struct eviction_config_t conf, uint64_t seed)
+{
+	struct evsets_ctx *ctx;
+	unsigned long i;
+
+	if (conf.stride < (int)sizeof(cache_block_t) || pool_sz < (unsigned long)conf.stride) {
+		return NULL;
+	}
+	ctx = (struct evsets_ctx *)calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		return NULL;
+	}
+
+	if (!pool) {
+		if (pool_open(&ctx->mem, pool_sz, NULL, POOL_POPULATE)) {
+			free(ctx);
+			return NULL;
+		}
+		pool = ctx->mem.base;
+	}
+
+	ctx->pool = pool;
+	ctx->pool_sz = pool_sz;
+	ctx->conf = conf;
+	ctx->conf.scratch = &ctx->scratch;
+	ctx->blocks = pool_sz / conf.stride;
+	ctx->free = ctx->blocks;
+	rng_init(&ctx->rng, seed);
+
+	// Only lines at the stride are picked, but expand_eviction_set uses the others
+	for (i = 0; i < pool_sz / sizeof(cache_block_t); i++) {
+		cache_block_t *x = &((cache_block_t *)pool)[i];
+		x->set = -2;
+		x->delta = 0;
+		x->next = x->prev = NULL;
+	}
+
+	if (ctx->conf.threshold <= 0) {
+		struct trace_mark_t m;
+		trace_mark(ctx->conf.trace, &m);
+		ctx->conf.threshold = oracle_calibrate(ctx->conf.oracle, ctx->pool, &ctx->conf);
+		trace_record(ctx->conf.trace, &m, TRACE_CALIBRATE, -1, -1, -1);
+		trace_flush(ctx->conf.trace);
+		printf("[+] Calibrated Threshold = %d\n", ctx->conf.threshold);
+		if (ctx->conf.threshold < 0) {
+			printf("[!] Error: calibration\n");
+			ctx_destroy(ctx);
+			return NULL;
+		}
+	}
+	return ctx;
+}
+
+/**
+ * Same search as find_eviction_set, but lines come from the context: the
+ * lines of a failed attempt and every line the reduction discards are
+ * returned to the pool, and only the eviction set (and its victim, if that
+ * is a line of the pool) stays taken until ctx_release. With conf.conflict_set, the conflict set is built by the
+ * first lookup and stays taken; later lookups carve their set out of it.
+ *
+ * @return 0 on success, 1 otherwise.
+ */
+int
+ctx_find(struct evsets_ctx *ctx, char *victim, struct eviction_set_t *out)
+{
+	struct eviction_config_t *conf = &ctx->conf;
+	struct rng_t saved = *rng_thread();
+	struct trace_mark_t run, m;
+	cache_block_t *set = NULL, *can, *v = (cache_block_t *)victim;
+	int rep, ret = 1, own = 0;
+
+	trace_mark(conf->trace, &run);
+
+	out->victim = victim;
+	out->set = NULL;
+	out->len = 0;
+	out->owned = 0;
+
+	// Shuffles in the reduction draw from the context as well
+	*rng_thread() = ctx->rng;
+
+	*(volatile char *)victim; // touch line
+
+	// A victim from the pool must not end up in its own candidate set
+	own = !claim(ctx, v);
+
+	// The conflict set of an earlier lookup holds every color of its sample
+	if (conf->conflict_set && ctx->cs) {
+		ret = conflict_set_carve(&ctx->cs, victim, &set, conf);
+		if (ret) {
+			printf("[!] Error: conflict set has no eviction set for victim, rebuilding\n");
+			put(ctx, ctx->cs);
+			ctx->cs = NULL;
+		}
+	}
+
+	for (rep = 0; ret && rep < CTX_MAX_REPS; rep++) {
+		if (rep && conf->stats) {
+			conf->stats->retries++;
+		}
+		can = NULL;
+		trace_mark(conf->trace, &m);
+		set = take(ctx, conf->initial_set_size, 0);
+		trace_record(conf->trace, &m, TRACE_PICK, -1, set ? conf->initial_set_size : 0, -1);
+		if (!set) {
+			printf("[!] Error: %lu free lines, %d needed\n", ctx->free, conf->initial_set_size);
+			break;
+		}
+		trace_mark(conf->trace, &m);
+		int evicts = oracle_test_len(conf, set, conf->initial_set_size, victim);
+		trace_record(conf->trace, &m, TRACE_INITIAL, -1, conf->initial_set_size, -1);
+		if (!evicts) {
+			printf("[!] Error: invalid candidate set\n");
+			put(ctx, set);
+			continue;
+		}
+		if (conf->conflict_set) {
+			trace_mark(conf->trace, &m);
+			conflict_set_build(&set, &can, conf);
+			trace_record(conf->trace, &m, TRACE_CONFLICT, -1, list_length(set), list_length(can));
+			put(ctx, can);
+			ctx->cs = set;
+			set = NULL;
+			ret = conflict_set_carve(&ctx->cs, victim, &set, conf);
+			if (ret) {
+				printf("[!] Error: conflict set does not evict victim\n");
+				put(ctx, ctx->cs);
+				ctx->cs = NULL;
+			}
+			continue;
+		}
+
+		ret = reduce_eviction_set(&set, &can, victim, conf);
+		if (ret) {
+			ret = repair_eviction_set(&set, &can, victim, conf);
+		}
+		put(ctx, can);
+		if (ret) {
+			printf("[!] Error: optimal eviction set not found (length=%d)\n", list_length(set));
+			put(ctx, set);
+		}
+	}
+
+	trace_record(conf->trace, &run, TRACE_RUN, -1, ret ? -1 : list_length(set), -1);
+	trace_flush(conf->trace);
+
+	ctx->rng = *rng_thread();
+	*rng_thread() = saved;
+	if (ret) {
+		if (own) {
+			v->next = NULL;
+			put(ctx, v);
+		}
+		return 1;
+	}
+	out->set = set;
+	out->len = list_length(set);
+	out->owned = own;
+	return 0;
+}
+
+/**
+ * Repairs es if it no longer evicts its victim (lines lost congruence, were
+ * remapped or a noisy test let a bad line in), with fresh lines from the
+ * context as spares: see repair_eviction_set. This costs a few tests for
+ * each bad line instead of a whole ctx_find. Unused spares are returned.
+ *
+ * @return 0 if es evicts its victim, 1 otherwise (es keeps whatever lines
+ * are left of the set, to be released).
+ */
+int
+ctx_repair(struct evsets_ctx *ctx, struct eviction_set_t *es)
+{
+	struct eviction_config_t *conf = &ctx->conf;
+	cache_block_t *set = es->set, *can;
+	int ret;
+
+	if (oracle_test(conf, es->set, es->victim)) {
+		return 0;
+	}
+	can = take(ctx, conf->initial_set_size, 0);
+	if (!can) {
+		printf("[!] Error: %lu free lines, %d needed\n", ctx->free, conf->initial_set_size);
+		return 1;
+	}
+	ret = repair_eviction_set(&set, &can, es->victim, conf);
+
+	put(ctx, can);
+	es->set = set;
+	es->len = list_length(set);
+	return ret;
+}
+
+static cache_block_t *
+lines_take(void *priv, unsigned long offset, int n)
+{
+	return take((struct evsets_ctx *)priv, n, offset);
+}
+
+static int
+lines_claim(void *priv, cache_block_t *x)
+{
+	return claim((struct evsets_ctx *)priv, x);
+}
+
+static void
+lines_put(void *priv, cache_block_t *set)
+{
+	put((struct evsets_ctx *)priv, set);
+}
+
+/**
+ * expand_eviction_set for a set found by ctx_find, with every line taken
+ * from and returned to the context. The expanded sets stay taken until
+ * ctx_release. The stride must be a multiple of the page size, so that the
+ * lines at an offset into each stride share their page offset.
+ *
+ * @return number of offsets with a valid eviction set.
+ */
+int
+ctx_expand(struct evsets_ctx *ctx, struct eviction_set_t *base, struct eviction_set_t *out)
+{
+	struct line_source_t src = { lines_take, lines_claim, lines_put, ctx };
+	struct rng_t saved = *rng_thread();
+	int found;
+
+	if (ctx->conf.stride % CTX_PAGE_SIZE) {
+		printf("[!] Error: expanding needs a stride that is a multiple of %d\n", CTX_PAGE_SIZE);
+		return 0;
+	}
+	*rng_thread() = ctx->rng;
+	found = expand_eviction_set_from(&src, base, ctx->conf, out);
+	ctx->rng = *rng_thread();
+	*rng_thread() = saved;
+	return found;
+}
+
+void
+ctx_release(struct evsets_ctx *ctx, struct eviction_set_t *es)
+{
+	put(ctx, es->set);
+	if (es->owned) {
+		((cache_block_t *)es->victim)->next = NULL;
+		put(ctx, (cache_block_t *)es->victim);
+	}
+	es->set = NULL;
+	es->len = 0;
+	es->owned = 0;
+}
+
+void
+ctx_destroy(struct evsets_ctx *ctx)
+{
+	if (!ctx) {
+		return;
+	}
+	eviction_scratch_free(&ctx->scratch);
+	if (ctx->mem.base) {
+		pool_close(&ctx->mem);
+	}
+	free(ctx);
+}
+
+int
+ctx_threshold(struct evsets_ctx *ctx)
+{
+	return ctx->conf.threshold;
+}
+
+unsigned long
+ctx_free_lines(struct evsets_ctx *ctx)
+{
+	return ctx->free;
+}
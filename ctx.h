@@ -0,0 +1,28 @@
+#ifndef ctx_H
+#define ctx_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+
+/*
+ * Search context for finding eviction sets for many victims in one process.
+ * The pool is initialized once and its lines are then handed out and taken
+ * back as searches pick and release them, so no search touches the whole
+ * pool. The threshold, reduction buffers and random state carry over from
+ * one ctx_find to the next.
+ */
+struct evsets_ctx;
+
+struct evsets_ctx *ctx_create(char *pool, unsigned long pool_sz, struct eviction_config_t conf, uint64_t seed);
+int ctx_find(struct evsets_ctx *ctx, char *victim, struct eviction_set_t *out);
+int ctx_expand(struct evsets_ctx *ctx, struct eviction_set_t *base, struct eviction_set_t *out);
+int ctx_repair(struct evsets_ctx *ctx, struct eviction_set_t *es);
+void ctx_release(struct evsets_ctx *ctx, struct eviction_set_t *es);
+void ctx_destroy(struct evsets_ctx *ctx);
+
+int ctx_threshold(struct evsets_ctx *ctx);
+unsigned long ctx_free_lines(struct evsets_ctx *ctx);
+
+#endif /* ctx_H */
@@ -1,6 +1,12 @@
 #include "cache.h"
 #include "list_utils.h"
 #include "eviction.h"
+#include "oracle.h"
+#include "cset.h"
+#include "conflict.h"
+#include "rng.h"
+#include "reduction.h"
+#include "trace.h"
 
 #include <fcntl.h>
 #include <getopt.h>
@@ -19,13 +25,20 @@
 #define MAX_REPS_BACK 100
 #define MAX_REPS 50
 
+#define LINE_SIZE 64
+#define PAGE_SIZE 4096
+
+#define ANY_BATCH 16 // lines timed per traversal in find_any_eviction_set
+#define EXPAND_MARGIN 3 // lines per way and color drawn by expand_fallback
+#define ANY_GROWTH 8 // bound on the candidate list, in multiples of the initial sample
+
 static void
 shuffle(int *array, size_t n)
 {
 	size_t i;
 	if (n > 1) {
 		for (i = 0; i < n - 1; i++) {
-			size_t j = i + rand() / (RAND_MAX / (n - i) + 1);
+			size_t j = i + rng_range(n - i);
 			int t = array[j];
 			array[j] = array[i];
 			array[i] = t;
@@ -33,37 +46,336 @@ shuffle(int *array, size_t n)
 	}
 }
 
+/**
+ * Buffer i of s, grown to at least size bytes and zeroed.
+ *
+ * @return the buffer, or NULL if it could not be grown.
+ */
+void *
+eviction_scratch_get(struct eviction_scratch_t *s, int i, size_t size)
+{
+	if (s->size[i] < size) {
+		void *p = realloc(s->buf[i], size);
+		if (!p) {
+			return NULL;
+		}
+		s->buf[i] = p;
+		s->size[i] = size;
+	}
+	memset(s->buf[i], 0, size);
+	return s->buf[i];
+}
+
+void
+eviction_scratch_free(struct eviction_scratch_t *s)
+{
+	int i;
+	for (i = 0; i < EVICTION_SCRATCH_BUFS; i++) {
+		free(s->buf[i]);
+		s->buf[i] = NULL;
+		s->size[i] = 0;
+	}
+}
+
+enum { SCRATCH_CHUNKS, SCRATCH_ICHUNKS, SCRATCH_BACK, SCRATCH_MEMO };
+
+static void *
+scratch_calloc(struct eviction_config_t *conf, int i, size_t n, size_t size)
+{
+	if (!conf->scratch) {
+		return calloc(n, size);
+	}
+	return eviction_scratch_get(conf->scratch, i, n * size);
+}
+
+static void
+scratch_free(struct eviction_config_t *conf, void *p)
+{
+	if (!conf->scratch) {
+		free(p);
+	}
+}
+
+/*
+ * Outcomes of the tests of one gt_eviction call, keyed by the identity of
+ * the tested set: the XOR of its mixed line addresses and its length, which
+ * does not depend on the order of the list. Backtracking rebuilds earlier
+ * levels in their original order, so their chunks, and the sets tested at
+ * that level, come out the same and are answered from here instead of being
+ * timed again. A set left by backtracking is marked dead: it evicts, but
+ * none of its subsets did, so its parent level tries its other chunks
+ * first. A full table overwrites the home slot of the key.
+ */
+#define MEMO_SIZE 4096 // entries, a power of two
+#define MEMO_PROBES 8
+
+struct memo_entry_t {
+	uint64_t key;
+	int len; // 0: empty
+	int evicts;
+	int dead; // every subset tested at its level failed
+};
+
+static inline uint64_t
+mix(const void *p)
+{
+	uint64_t x = (uintptr_t)p;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// NULL if the set was not recorded
+static struct memo_entry_t *
+memo_get(struct memo_entry_t *memo, uint64_t key, int len)
+{
+	unsigned int i, h = (key ^ len) & (MEMO_SIZE - 1);
+
+	for (i = 0; i < MEMO_PROBES; i++) {
+		struct memo_entry_t *e = &memo[(h + i) & (MEMO_SIZE - 1)];
+		if (!e->len) {
+			return NULL;
+		}
+		if (e->key == key && e->len == len) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static struct memo_entry_t *
+memo_put(struct memo_entry_t *memo, uint64_t key, int len, int evicts)
+{
+	unsigned int i, h = (key ^ len) & (MEMO_SIZE - 1);
+	struct memo_entry_t *e = &memo[h];
+
+	for (i = 0; i < MEMO_PROBES; i++) {
+		struct memo_entry_t *s = &memo[(h + i) & (MEMO_SIZE - 1)];
+		if (!s->len || (s->key == key && s->len == len)) {
+			e = s;
+			break;
+		}
+	}
+	e->key = key;
+	e->len = len;
+	e->evicts = evicts;
+	e->dead = 0;
+	return e;
+}
+
+// Size of chunk k of list_split over len lines and n chunks
 static int
-gt_eviction(cache_block_t **ptr, cache_block_t **can, char *victim, int cache_way, int rounds, int threshold)
+chunk_len(int len, int n, int k)
+{
+	return k < n - 1 ? len / n : len - (n - 1) * (len / n);
+}
+
+/*
+ * Undoes list_from_chunks(ptr, chunks, k, n) for a set of len lines:
+ * rest holds chunks k + 1 ... n - 1, 0 ... k - 1 in that order, so the
+ * original list is the tail of rest after the first of these, chunk k, then
+ * the head of rest.
+ */
+static cache_block_t *
+unsplit(cache_block_t *rest, cache_block_t *chunk, int k, int len, int n)
 {
+	int i, hi = len - k * (len / n) - chunk_len(len, n, k);
+	cache_block_t *lo = rest, *tail = NULL, *set;
+
+	for (i = 0; i < hi; i++) {
+		tail = lo;
+		lo = lo->next;
+	}
+	if (tail) {
+		tail->next = NULL;
+	}
+	if (lo) {
+		lo->prev = NULL;
+	}
+	set = lo;
+	list_concat(&set, chunk);
+	list_concat(&set, hi ? rest : NULL);
+	return set;
+}
+
+struct level_t {
+	cache_block_t *chunk; // removed at this level
+	int k; // its index in the split
+	int len; // of the set before the removal
+	uint64_t key; // identity of that set
+};
+
+int
+gt_eviction(cache_block_t **ptr, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	int cache_way = conf->cache_way, n_chunks = cache_way + 1;
+
 	// Random chunk selection
-	cache_block_t **chunks = (cache_block_t **)calloc(cache_way + 1, sizeof(cache_block_t *));
+	cache_block_t **chunks =
+		(cache_block_t **)scratch_calloc(conf, SCRATCH_CHUNKS, n_chunks, sizeof(cache_block_t *));
 	if (!chunks) {
 		return 1;
 	}
-	int *ichunks = (int *)calloc(cache_way + 1, sizeof(int)), i;
+	int *ichunks = (int *)scratch_calloc(conf, SCRATCH_ICHUNKS, n_chunks, sizeof(int)), i;
 	if (!ichunks) {
-		free(chunks);
+		scratch_free(conf, chunks);
 		return 1;
 	}
 
-	int len = list_length(*ptr), cans = 0;
+	int len = list_length(*ptr), cans = 0, l = 0;
+	uint64_t key = 0, keys[n_chunks];
+	cache_block_t *x;
 
-	// Calculate length: h = log(a/(a+1), a/n)
-	double sz = (double)cache_way / len;
-	double rate = (double)cache_way / (cache_way + 1);
-	int h = ceil(log(sz) / log(rate)), l = 0;
+	for (x = *ptr; x; x = x->next) {
+		key ^= mix(x);
+	}
 
-	// Backtrack record
-	cache_block_t **back =
-		(cache_block_t **)calloc(h * 2, sizeof(cache_block_t *)); // TODO: check height bound
-	if (!back) {
-		free(chunks);
-		free(ichunks);
+	// Each level removes at least one line, so the stack never exceeds this
+	int depth = len > cache_way ? len - cache_way : 1;
+	struct level_t *back = (struct level_t *)scratch_calloc(conf, SCRATCH_BACK, depth, sizeof(struct level_t));
+	struct memo_entry_t *memo =
+		(struct memo_entry_t *)scratch_calloc(conf, SCRATCH_MEMO, MEMO_SIZE, sizeof(struct memo_entry_t));
+	if (!back || !memo) {
+		scratch_free(conf, chunks);
+		scratch_free(conf, ichunks);
+		scratch_free(conf, back);
+		scratch_free(conf, memo);
 		return 1;
 	}
 
+	struct trace_mark_t m;
 	int repeat = 0;
+	do {
+		for (i = 0; i < n_chunks; i++) {
+			ichunks[i] = i;
+		}
+		shuffle(ichunks, n_chunks);
+
+		// Reduce
+		while (len > cache_way) {
+			trace_mark(conf->trace, &m);
+			list_split(*ptr, chunks, n_chunks);
+			for (i = 0; i < n_chunks; i++) {
+				keys[i] = key;
+				for (x = chunks[i]; x; x = x->next) {
+					keys[i] ^= mix(x);
+				}
+			}
+			int n = 0, k = 0, ret = 0;
+
+			// Try paths
+			do {
+				struct memo_entry_t *e;
+				int sub;
+
+				k = ichunks[n];
+				sub = len - chunk_len(len, n_chunks, k);
+				list_from_chunks(ptr, chunks, k, n_chunks);
+				n = n + 1;
+				e = memo_get(memo, keys[k], sub);
+				if (e && e->dead) {
+					// Known to evict, but a dead end: try the others
+					ret = 0;
+				} else if (e) {
+					ret = e->evicts;
+					if (conf->stats) {
+						conf->stats->cached++;
+					}
+				} else {
+					ret = oracle_test_len(conf, *ptr, sub, victim);
+					memo_put(memo, keys[k], sub, ret);
+				}
+			} while (!ret && (n < n_chunks));
+
+			// If find smaller eviction set remove chunk
+			if (ret && n <= cache_way) {
+				back[l].chunk = chunks[k]; // store ptr to discarded chunk
+				back[l].k = k;
+				back[l].len = len;
+				back[l].key = key;
+				len = len - chunk_len(len, n_chunks, k);
+				cans += back[l].len - len; // add length of removed chunk
+				key = keys[k];
+
+				trace_record(conf->trace, &m, TRACE_LEVEL, l, len, cans);
+
+				l = l + 1; // go to next lvl
+				if (l == depth) {
+					break;
+				}
+			}
+			// Else, restore this level and undo the last removal
+			else if (l > 0) {
+				*ptr = unsplit(*ptr, chunks[k], k, len, n_chunks);
+				// This set evicts (its level was entered on a hit), no subset does
+				memo_put(memo, key, len, 1)->dead = 1;
+				l = l - 1;
+				*ptr = unsplit(*ptr, back[l].chunk, back[l].k, back[l].len, n_chunks);
+				cans -= back[l].len - len;
+				len = back[l].len;
+				key = back[l].key;
+				back[l].chunk = NULL;
+				goto mycont;
+			} else {
+				*ptr = unsplit(*ptr, chunks[k], k, len, n_chunks); // recover last case
+				break;
+			}
+		}
+
+		break;
+	mycont:
+		trace_record(conf->trace, &m, TRACE_BACKTRACK, l, len, cans);
+		if (conf->stats) {
+			conf->stats->backtracks++;
+		}
+
+	} while (l > 0 && repeat++ < MAX_REPS_BACK);
+
+	// recover discarded elements
+	for (i = 0; i < l; i++) {
+		list_concat(can, back[i].chunk);
+	}
+
+	scratch_free(conf, chunks);
+	scratch_free(conf, ichunks);
+	scratch_free(conf, back);
+	scratch_free(conf, memo);
+
+	int ret = 0;
+	ret = oracle_test_len(conf, *ptr, len, victim);
+	if (ret) {
+		if (len > cache_way) {
+			return 1;
+		}
+	} else {
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+gt_eviction_array(cache_block_t **ptr, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	int cache_way = conf->cache_way, i;
+	struct cset_t c;
+
+	if (cset_init(&c, list_length(*ptr)) || cset_from_list(&c, *ptr)) {
+		cset_free(&c);
+		return 1;
+	}
+
+	// Each level removes at least one line, so the stack never exceeds this
+	int depth = c.len > cache_way ? c.len - cache_way : 1;
+	int *back = (int *)scratch_calloc(conf, SCRATCH_BACK, depth, sizeof(int)), l = 0;
+	int ichunks[cache_way + 1];
+	if (!back) {
+		cset_free(&c);
+		return 1;
+	}
+
+	struct trace_mark_t m;
+	int repeat = 0, cans = 0;
 	do {
 		for (i = 0; i < cache_way + 1; i++) {
 			ichunks[i] = i;
@@ -71,59 +383,57 @@ gt_eviction(cache_block_t **ptr, cache_block_t **can, char *victim, int cache_wa
 		shuffle(ichunks, cache_way + 1);
 
 		// Reduce
-		while (len > cache_way) {
-			list_split(*ptr, chunks, cache_way + 1);
-			int n = 0, ret = 0;
+		while (c.len > cache_way) {
+			int n = 0, ret = 0, from = 0, to = 0;
 
+			trace_mark(conf->trace, &m);
 			// Try paths
 			do {
-				list_from_chunks(ptr, chunks, ichunks[n], cache_way + 1);
+				cset_chunk(c.len, cache_way + 1, ichunks[n], &from, &to);
 				n = n + 1;
-				ret = tests_avg(*ptr, victim, rounds, threshold);
+				ret = oracle_test_len(conf, cset_link(&c, 0, c.len, from, to), c.len - (to - from), victim);
 			} while (!ret && (n < cache_way + 1));
 
 			// If find smaller eviction set remove chunk
 			if (ret && n <= cache_way) {
-				back[l] = chunks[ichunks[n - 1]]; // store ptr to discarded chunk
-				cans += list_length(back[l]); // add length of removed chunk
-				len = list_length(*ptr);
+				back[l] = to - from;
+				cans += back[l];
+				cset_remove(&c, from, to);
 
-				printf("\tlvl=%d: eset=%d, removed=%d (%d)\n", l, len, cans, len + cans);
+				trace_record(conf->trace, &m, TRACE_LEVEL, l, c.len, cans);
 
 				l = l + 1; // go to next lvl
 			}
 			// Else, re-add last removed chunk and try again
 			else if (l > 0) {
-				list_concat(ptr, chunks[ichunks[n - 1]]); // recover last case
 				l = l - 1;
-				cans -= list_length(back[l]);
-				list_concat(ptr, back[l]);
-				back[l] = NULL;
-				len = list_length(*ptr);
+				cans -= back[l];
+				c.len += back[l];
 				goto mycont;
 			} else {
-				list_concat(ptr, chunks[ichunks[n - 1]]); // recover last case
 				break;
 			}
 		}
 
 		break;
 	mycont:
-		printf("\tbacktracking step\n");
+		trace_record(conf->trace, &m, TRACE_BACKTRACK, l, c.len, cans);
+		if (conf->stats) {
+			conf->stats->backtracks++;
+		}
 
 	} while (l > 0 && repeat++ < MAX_REPS_BACK);
 
 	// recover discarded elements
-	for (i = 0; i < h * 2; i++) {
-		list_concat(can, back[i]);
-	}
+	*ptr = cset_link(&c, 0, c.len, -1, -1);
+	list_concat(can, cset_link(&c, c.len, c.size, -1, -1));
 
-	free(chunks);
-	free(ichunks);
-	free(back);
+	int len = c.len;
+	cset_free(&c);
+	scratch_free(conf, back);
 
 	int ret = 0;
-	ret = tests_avg(*ptr, victim, rounds, threshold);
+	ret = oracle_test_len(conf, *ptr, len, victim);
 	if (ret) {
 		if (len > cache_way) {
 			return 1;
@@ -135,37 +445,89 @@ gt_eviction(cache_block_t **ptr, cache_block_t **can, char *victim, int cache_wa
 	return 0;
 }
 
-int find_eviction_set(char *pool, unsigned long pool_sz, char *victim, struct eviction_config_t conf, cache_block_t **eviction_set)
+static int
+setup_threshold(char *victim, struct eviction_config_t *conf)
+{
+	struct trace_mark_t m;
+
+	if (conf->threshold <= 0) {
+		trace_mark(conf->trace, &m);
+		conf->threshold = oracle_calibrate(conf->oracle, victim, conf);
+		trace_record(conf->trace, &m, TRACE_CALIBRATE, -1, -1, -1);
+		printf("[+] Calibrated Threshold = %d\n", conf->threshold);
+	} else {
+		printf("[+] Default Threshold = %d\n", conf->threshold);
+	}
+
+	if (conf->threshold < 0) {
+		printf("[!] Error: calibration\n");
+		return 1;
+	}
+	return 0;
+}
+
+static cache_block_t *
+pick(char *pool, unsigned long pool_sz, struct eviction_config_t *conf)
+{
+	cache_block_t *set = (cache_block_t *)&pool[0];
+	struct trace_mark_t m;
+	int n = conf->initial_set_size;
+
+	printf("[+] Pick %d random from list\n", n);
+	trace_mark(conf->trace, &m);
+	initialize_list(set, pool_sz);
+	pick_n_random_from_list(set, conf->stride, pool_sz, n);
+	trace_record(conf->trace, &m, TRACE_PICK, -1, n, -1);
+	if (list_length(set) != n) {
+		printf("[!] Error: broken list\n");
+		return NULL;
+	}
+	return set;
+}
+
+static void
+retry(struct eviction_config_t *conf)
+{
+	if (conf->stats) {
+		conf->stats->retries++;
+	}
+}
+
+static int
+search(char *pool, unsigned long pool_sz, char *victim, struct eviction_config_t conf, cache_block_t **eviction_set)
 {
 	cache_block_t *set = NULL;
 	cache_block_t *can = NULL;
+	cache_block_t *local = NULL, **cs = conf.conflict ? conf.conflict : &local;
 
 	*victim = 0; // touch line
 
 	int rep = 0;
 
-	conf.threshold = calibrate(victim, &conf);
-	printf("[+] Calibrated Threshold = %d\n", conf.threshold);
-
-	if (conf.threshold < 0) {
-		printf("[!] Error: calibration\n");
+	if (setup_threshold(victim, &conf)) {
 		return 1;
 	}
 
-pick:
+	// A conflict set from an earlier search holds every color of the pool
+	if (conf.conflict_set && *cs) {
+		if (!conflict_set_carve(cs, victim, eviction_set, &conf)) {
+			return 0;
+		}
+		printf("[!] Error: conflict set has no eviction set for victim, rebuilding\n");
+		*cs = NULL;
+	}
 
-	set = (cache_block_t *)&pool[0];
-	initialize_list(set, pool_sz);
+pick:
 
-	int n = conf.initial_set_size;
-	printf("[+] Pick %d random from list\n", n);
-	pick_n_random_from_list(set, conf.stride, pool_sz, n);
-	if (list_length(set) != n) {
-		printf("[!] Error: broken list\n");
+	set = pick(pool, pool_sz, &conf);
+	if (!set) {
 		return 1;
 	}
 
-	int ret = tests_avg(set, victim, conf.rounds, conf.threshold);
+	struct trace_mark_t m;
+	trace_mark(conf.trace, &m);
+	int ret = oracle_test_len(&conf, set, conf.initial_set_size, victim);
+	trace_record(conf.trace, &m, TRACE_INITIAL, -1, conf.initial_set_size, -1);
 
 	if (victim && ret) {
 		printf("[+] Initial candidate set evicted victim\n");
@@ -173,6 +535,7 @@ pick:
 		printf("[!] Error: invalid candidate set\n");
 		if (rep < MAX_REPS) {
 			rep++;
+			retry(&conf);
 			goto pick;
 		} else if (rep >= MAX_REPS) {
 			printf("[!] Error: exceeded max repetitions\n");
@@ -180,13 +543,37 @@ pick:
 		return 1;
 	}
 
+	if (conf.conflict_set) {
+		printf("[+] Building conflict set...\n");
+		trace_mark(conf.trace, &m);
+		conflict_set_build(&set, &can, &conf);
+		trace_record(conf.trace, &m, TRACE_CONFLICT, -1, list_length(set), list_length(can));
+		printf("[+] Conflict set: %d lines (%d discarded)\n", list_length(set), list_length(can));
+		*cs = set;
+		if (!conflict_set_carve(cs, victim, eviction_set, &conf)) {
+			return 0;
+		}
+		printf("[!] Error: conflict set does not evict victim\n");
+		*cs = NULL;
+		if (rep < MAX_REPS) {
+			rep++;
+			retry(&conf);
+			goto pick;
+		}
+		return 1;
+	}
+
 	int len = 0;
 	// Iterate over all colors of conf.offset
 	do {
 		printf("[+] Created linked list structure (%d elements)\n", list_length(set));
 		printf("[+] Starting group reduction...\n");
 
-		ret = gt_eviction(&set, &can, victim, conf.cache_way, conf.rounds, conf.threshold);
+		ret = reduce_eviction_set(&set, &can, victim, &conf);
+		if (ret) {
+			// The discarded lines hold spares for whatever the reduction lost
+			ret = repair_eviction_set(&set, &can, victim, &conf);
+		}
 		len = list_length(set);
 
 		if (ret) {
@@ -195,6 +582,7 @@ pick:
 				list_concat(&set, can);
 				can = NULL;
 				rep++;
+				retry(&conf);
 				// select a new initial set
 				printf("[!] Error: repeat, pick a new set\n");
 				goto pick;
@@ -216,3 +604,510 @@ pick:
 
 	return ret;
 }
+
+int
+find_eviction_set(char *pool, unsigned long pool_sz, char *victim, struct eviction_config_t conf,
+		  cache_block_t **eviction_set)
+{
+	struct trace_mark_t m;
+	int ret;
+
+	trace_mark(conf.trace, &m);
+	ret = search(pool, pool_sz, victim, conf, eviction_set);
+	trace_record(conf.trace, &m, TRACE_RUN, -1, ret ? -1 : list_length(*eviction_set), -1);
+	trace_flush(conf.trace);
+	return ret;
+}
+
+static void
+append(cache_block_t **head, cache_block_t **tail, cache_block_t *x)
+{
+	x->next = NULL;
+	x->prev = *tail;
+	if (*tail) {
+		(*tail)->next = x;
+	} else {
+		*head = x;
+	}
+	*tail = x;
+}
+
+// Up to n free lines of the pool at random, at the same stride as pick
+static cache_block_t *
+draw(char *pool, unsigned long pool_sz, struct eviction_config_t *conf, int n)
+{
+	unsigned long blocks = pool_sz / conf->stride;
+	int i, tries = n * 4;
+	cache_block_t *set = NULL, *tail = NULL, *x;
+
+	for (i = 0; n > 0 && i < tries; i++) {
+		x = (cache_block_t *)&pool[rng_range(blocks) * conf->stride];
+		if (x->set != -2) {
+			continue;
+		}
+		x->set = -1;
+		append(&set, &tail, x);
+		n--;
+	}
+	return set;
+}
+
+// Hands the lines of set back to draw
+static void
+release(cache_block_t *set)
+{
+	cache_block_t *next;
+
+	for (; set; set = next) {
+		next = set->next;
+		set->set = -2;
+		set->next = set->prev = NULL;
+	}
+}
+
+/*
+ * find_any_eviction_set on a pool whose free lines are marked -2: only those
+ * are drawn, and every line drawn but not returned is marked free again.
+ */
+static int
+any_search(char *pool, unsigned long pool_sz, struct eviction_config_t conf, struct eviction_set_t *out)
+{
+	cache_block_t *todo, *kept = NULL, *tail = NULL, *can = NULL;
+	char *batch[ANY_BATCH], *victim = NULL;
+	int evicted[ANY_BATCH];
+	int i, n, ret = 1, rep, len = 0, max = conf.initial_set_size * ANY_GROWTH;
+	struct trace_mark_t m;
+
+	out->victim = NULL;
+	out->set = NULL;
+	out->len = 0;
+
+	// -a l only selects this search, the victim's set is reduced as usual
+	if (conf.algorithm == 'l') {
+		conf.algorithm = 0;
+	}
+
+	printf("[+] Pick %d random from list\n", conf.initial_set_size);
+	trace_mark(conf.trace, &m);
+	todo = draw(pool, pool_sz, &conf, conf.initial_set_size);
+	trace_record(conf.trace, &m, TRACE_PICK, -1, conf.initial_set_size, -1);
+	if (!todo || setup_threshold((char *)todo, &conf)) {
+		release(todo);
+		return 1;
+	}
+
+	while (!victim && len < max) {
+		if (!todo && !(todo = draw(pool, pool_sz, &conf, ANY_BATCH))) {
+			break;
+		}
+		for (n = 0; n < ANY_BATCH && todo; n++) {
+			batch[n] = (char *)todo;
+			todo = todo->next;
+		}
+		if (todo) {
+			todo->prev = NULL;
+		}
+
+		if (!oracle_test_batch(&conf, kept, len, batch, n, evicted)) {
+			for (i = 0; i < n; i++) {
+				append(&kept, &tail, (cache_block_t *)batch[i]);
+			}
+			len += n;
+			continue;
+		}
+
+		// Lines of one batch may evict each other, confirm one line at a time
+		for (i = 0; i < n && !victim; i++) {
+			if (oracle_test_len(&conf, kept, len, batch[i])) {
+				victim = batch[i];
+			} else {
+				append(&kept, &tail, (cache_block_t *)batch[i]);
+				len++;
+			}
+		}
+		for (; i < n; i++) {
+			((cache_block_t *)batch[i])->set = -2;
+		}
+	}
+
+	release(todo);
+	if (!victim) {
+		printf("[!] Error: no eviction within %d lines\n", len);
+		release(kept);
+		return 1;
+	}
+	((cache_block_t *)victim)->next = ((cache_block_t *)victim)->prev = NULL;
+	printf("[+] Candidate list of %d lines evicts %p\n", len, (void *)victim);
+
+	for (rep = 0; ret && rep < MAX_REPS; rep++) {
+		if (rep) {
+			retry(&conf);
+		}
+		ret = reduce_eviction_set(&kept, &can, victim, &conf);
+		if (ret) {
+			list_concat(&kept, can);
+			can = NULL;
+			if (!oracle_test(&conf, kept, victim)) {
+				printf("[!] Error: candidate list no longer evicts %p\n", (void *)victim);
+				break;
+			}
+		}
+	}
+	if (ret) {
+		release(kept);
+		release((cache_block_t *)victim);
+		return 1;
+	}
+	release(can);
+
+	out->victim = victim;
+	out->set = kept;
+	out->len = list_length(kept);
+	return 0;
+}
+
+/**
+ * Finds an eviction set for any cache set, without a given victim. Lines of
+ * a small sample join a candidate list ANY_BATCH at a time: each batch is
+ * timed after a single traversal of the list (oracle_test_batch), and the
+ * first line the list evicts becomes the victim, whose eviction set is then
+ * reduced out of the list. Since the list never evicts its own lines, it
+ * holds at most one associativity worth of lines per cache set, which keeps
+ * it far smaller than the initial set of a victim-specific search. If the
+ * sample runs out, it is grown with fresh lines of the pool.
+ *
+ * @return 0 on success, 1 otherwise.
+ */
+int
+find_any_eviction_set(char *pool, unsigned long pool_sz, struct eviction_config_t conf, struct eviction_set_t *out)
+{
+	initialize_list((cache_block_t *)pool, pool_sz);
+	return any_search(pool, pool_sz, conf, out);
+}
+
+/**
+ * Up to n find_any_eviction_set searches on the same pool. The pool is
+ * initialized once, and the lines of every set found (victim included) are
+ * marked with its index, so later searches never draw them.
+ *
+ * @return number of eviction sets stored in sets.
+ */
+int
+find_any_eviction_sets(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+		       struct eviction_set_t *sets, int n)
+{
+	cache_block_t *x;
+	int i, found = 0;
+
+	initialize_list((cache_block_t *)pool, pool_sz);
+	for (i = 0; i < n; i++) {
+		if (any_search(pool, pool_sz, conf, &sets[found])) {
+			continue;
+		}
+		((cache_block_t *)sets[found].victim)->set = found;
+		for (x = sets[found].set; x; x = x->next) {
+			x->set = found;
+		}
+		found++;
+	}
+	return found;
+}
+
+// Removes every line of *from evicted by es, marking it with color
+static void
+drop_congruent(cache_block_t **from, cache_block_t *es, int color, struct eviction_config_t *conf)
+{
+	cache_block_t *keep = NULL, *tail = NULL, *x = *from, *next;
+
+	while (x) {
+		next = x->next;
+		if (oracle_test(conf, es, (char *)x)) {
+			x->set = color;
+		} else {
+			x->prev = tail;
+			if (tail) {
+				tail->next = x;
+			} else {
+				keep = x;
+			}
+			tail = x;
+		}
+		x = next;
+	}
+	if (tail) {
+		tail->next = NULL;
+	}
+	*from = keep;
+}
+
+// Colors at one page offset: all cache sets whose low index bits the offset fixes
+static int
+colors_at(struct eviction_config_t *conf, int stride)
+{
+	int colors = conf->cache_size / (LINE_SIZE * conf->cache_way);
+	if (stride > LINE_SIZE) {
+		colors /= (stride < PAGE_SIZE ? stride : PAGE_SIZE) / LINE_SIZE;
+	}
+	return colors;
+}
+
+static double
+elapsed(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * Enumerates eviction sets for every color (cache set and slice) reachable
+ * from the pool at its page offset, from a single sample of
+ * conf.initial_set_size lines. Victims are taken from the sample itself;
+ * after each eviction set is found, it and every line congruent with it
+ * leave the sample, so no color is found twice. With conf.conflict_set the
+ * eviction sets are carved from the conflict set of the sample instead.
+ *
+ * @param sets receives up to max_sets eviction sets with their victims
+ * @return number of eviction sets found.
+ */
+int
+find_all_eviction_sets(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+		       struct eviction_set_t *sets, int max_sets)
+{
+	cache_block_t *sample, *cs = NULL, *victims = NULL, *v;
+	struct timespec start;
+	int found = 0, misses = 0;
+
+	int colors = colors_at(&conf, conf.stride);
+	if (colors > max_sets) {
+		colors = max_sets;
+	}
+
+	sample = pick(pool, pool_sz, &conf);
+	if (!sample || setup_threshold((char *)sample, &conf)) {
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (conf.conflict_set) {
+		printf("[+] Building conflict set...\n");
+		conflict_set_build(&sample, &victims, &conf);
+		cs = sample;
+		sample = NULL;
+		printf("[+] Conflict set: %d lines\n", list_length(cs));
+	} else {
+		victims = sample;
+	}
+
+	while (victims && found < colors) {
+		v = victims;
+		victims = v->next;
+		if (victims) {
+			victims->prev = NULL;
+		}
+		v->next = v->prev = NULL;
+
+		cache_block_t **source = conf.conflict_set ? &cs : &victims;
+		cache_block_t *es = NULL;
+		if (conflict_set_carve(source, (char *)v, &es, &conf)) {
+			// Too few congruent lines left for this color
+			misses++;
+			continue;
+		}
+
+		v->set = found;
+		for (cache_block_t *x = es; x; x = x->next) {
+			x->set = found;
+		}
+		drop_congruent(&victims, es, found, &conf);
+
+		sets[found].victim = (char *)v;
+		sets[found].set = es;
+		sets[found].len = list_length(es);
+		found++;
+
+		printf("[+] Color %d/%d: %d lines, %.02f sets/s\n", found, colors, sets[found - 1].len,
+		       found / elapsed(&start));
+	}
+
+	double t = elapsed(&start);
+	printf("[+] Found %d/%d eviction sets in %f seconds (%.02f sets/s, %d victims skipped)\n", found,
+	       colors, t, found / t, misses);
+	return found;
+}
+
+static cache_block_t *
+shift_line(void *p, long delta)
+{
+	return (cache_block_t *)((char *)p + delta);
+}
+
+struct pool_lines_t {
+	char *pool;
+	unsigned long pool_sz;
+};
+
+// Lines of a pool are free while their set is -2
+static cache_block_t *
+pool_take(void *priv, unsigned long offset, int n)
+{
+	struct pool_lines_t *p = (struct pool_lines_t *)priv;
+	unsigned long pages = p->pool_sz / PAGE_SIZE;
+	cache_block_t *set = NULL, *tail = NULL, *x;
+	int i, tries = n * 4;
+
+	for (i = 0; n > 0 && i < tries; i++) {
+		x = (cache_block_t *)&p->pool[rng_range(pages) * PAGE_SIZE + offset];
+		if (x->set != -2) {
+			continue;
+		}
+		x->set = -1;
+		append(&set, &tail, x);
+		n--;
+	}
+	return set;
+}
+
+static int
+pool_claim(void *priv, cache_block_t *x)
+{
+	struct pool_lines_t *p = (struct pool_lines_t *)priv;
+
+	if ((char *)x < p->pool || (char *)x >= p->pool + p->pool_sz || x->set != -2) {
+		return -1;
+	}
+	x->set = -1;
+	return 0;
+}
+
+static void
+pool_put(void *priv, cache_block_t *set)
+{
+	(void)priv;
+	for (; set; set = set->next) {
+		set->set = -2;
+	}
+}
+
+/*
+ * Reduction for one offset from the shifted set plus fresh lines at that
+ * offset. Lines are drawn for every color of the offset, EXPAND_MARGIN times
+ * the associativity each, since nothing is known about the victim's color
+ * when the slice hash is not linear. Lines that end up unused are released.
+ */
+static int
+expand_fallback(const struct line_source_t *src, cache_block_t **set, char *victim, struct eviction_config_t *conf)
+{
+	int n = colors_at(conf, PAGE_SIZE) * conf->cache_way * EXPAND_MARGIN, ret;
+	cache_block_t *can = NULL;
+
+	list_concat(set, src->take(src->priv, (uintptr_t)victim % PAGE_SIZE, n));
+
+	ret = !oracle_test(conf, *set, victim) || reduce_eviction_set(set, &can, victim, conf);
+	if (ret && *set) {
+		ret = repair_eviction_set(set, &can, victim, conf);
+	}
+	if (ret) {
+		list_concat(set, can);
+		can = *set;
+		*set = NULL;
+	}
+	src->put(src->priv, can);
+	return ret;
+}
+
+/**
+ * Derives eviction sets for all line offsets of a page from one verified
+ * eviction set. Lines of an eviction set agree on all physical bits above the
+ * line offset, so moving every element and the victim by the same multiple
+ * of 64 bytes keeps their set index congruent, and their slice too if the
+ * slice hash is linear (a power of two slices). Each shifted set is
+ * validated with a single test. If that fails, e.g. on parts whose hash
+ * folds onto 6 or 12 slices, a reduction from fresh lines at that offset
+ * runs (expand_fallback). Lines of the pool are free while their set is -2.
+ *
+ * @param out array of PAGE_SIZE / LINE_SIZE sets, indexed by line offset
+ * @return number of offsets with a valid eviction set.
+ */
+int
+expand_eviction_set(char *pool, unsigned long pool_sz, struct eviction_set_t *base, struct eviction_config_t conf,
+		    struct eviction_set_t *out)
+{
+	struct pool_lines_t p = { pool, pool_sz };
+	struct line_source_t src = { pool_take, pool_claim, pool_put, &p };
+
+	return expand_eviction_set_from(&src, base, conf, out);
+}
+
+/**
+ * Same as expand_eviction_set, with lines taken from and returned to src.
+ */
+int
+expand_eviction_set_from(const struct line_source_t *src, struct eviction_set_t *base,
+			 struct eviction_config_t conf, struct eviction_set_t *out)
+{
+	int k, own, found = 0, reduced = 0, base_off = ((uintptr_t)base->victim % PAGE_SIZE) / LINE_SIZE;
+	cache_block_t *x, *tail;
+
+	if (setup_threshold(base->victim, &conf)) {
+		return 0;
+	}
+
+	for (k = 0; k < PAGE_SIZE / LINE_SIZE; k++) {
+		long delta = (long)(k - base_off) * LINE_SIZE;
+		char *victim = base->victim + delta;
+		cache_block_t *set = NULL;
+
+		out[k].victim = victim;
+		out[k].set = NULL;
+		out[k].len = 0;
+		out[k].owned = 0;
+
+		if (k == base_off) {
+			out[k] = *base;
+			found++;
+			continue;
+		}
+
+		// A victim from the pool must not end up in its own set
+		own = !src->claim(src->priv, (cache_block_t *)victim);
+
+		tail = NULL;
+		for (x = base->set; x; x = x->next) {
+			cache_block_t *y = shift_line(x, delta);
+			if (src->claim(src->priv, y)) {
+				break;
+			}
+			append(&set, &tail, y);
+		}
+		if (x) {
+			// A shifted line is in use elsewhere, only fresh lines are left
+			src->put(src->priv, set);
+			set = NULL;
+		}
+
+		if (!set || !oracle_test_len(&conf, set, base->len, victim)) {
+			printf("[!] Offset %d: shifted set failed validation, reducing\n", k);
+			reduced++;
+			if (expand_fallback(src, &set, victim, &conf)) {
+				set = NULL;
+			}
+		}
+		if (!set) {
+			if (own) {
+				((cache_block_t *)victim)->next = NULL;
+				src->put(src->priv, (cache_block_t *)victim);
+			}
+			continue;
+		}
+
+		out[k].set = set;
+		out[k].len = list_length(set);
+		out[k].owned = own;
+		found++;
+	}
+
+	printf("[+] Expanded to %d/%d offsets (%d needed a reduction)\n", found, PAGE_SIZE / LINE_SIZE, reduced);
+	return found;
+}
@@ -9,6 +9,32 @@ typedef struct cache_block_t {
 	char pad[32]; // up to 64B
 } cache_block_t;
 
+struct oracle_t;
+struct traversal_t;
+struct trace_t;
+
+enum reduction_engine {
+	ENGINE_LIST, // split and relink the candidate list in place
+	ENGINE_ARRAY, // index ranges over an array, see cset.h
+};
+
+struct eviction_stats_t {
+	unsigned long tests; // oracle_test calls
+	unsigned long probes; // single measurements
+	unsigned long lines; // lines traversed
+	unsigned long backtracks; // chunks re-added by gt_eviction
+	unsigned long cached; // tests answered from the gt_eviction memo instead of timed
+	unsigned long retries; // fresh initial sets after a failed attempt
+};
+
+#define EVICTION_SCRATCH_BUFS 4
+
+// Buffers kept across reductions, see ctx.h
+struct eviction_scratch_t {
+	void *buf[EVICTION_SCRATCH_BUFS];
+	size_t size[EVICTION_SCRATCH_BUFS];
+};
+
 struct eviction_config_t {
 	int rounds, cal_rounds;
 	int stride;
@@ -16,10 +42,58 @@ struct eviction_config_t {
 	int initial_set_size;
 	int cache_way;
 	int cache_slices;
-	int threshold;
+	int threshold; // <= 0: calibrate
+	double test_error; // SPRT error rate per test, stops before rounds (0: average all rounds)
+	double cal_confidence; // stop calibration once hits/misses separate (0: run all cal_rounds)
+	const char *cal_cache; // threshold cache file (NULL: disabled)
+	struct oracle_t *oracle; // NULL: time real loads
+	const struct traversal_t *traversal; // eviction strategy (NULL: one forward pass)
+	char algorithm; // n|o|g|b, see reduction.h (0: g), or l for find_any_eviction_set
+	enum reduction_engine engine; // for g
+	int conflict_set; // reduce from the conflict set of the initial sample
+	cache_block_t **conflict; // with conflict_set: kept across find_eviction_set calls (NULL: one per call)
+	struct eviction_stats_t *stats; // counters, may be NULL
+	struct eviction_scratch_t *scratch; // reduction buffers (NULL: allocated per call)
+	struct trace_t *trace; // phase records, see trace.h (NULL: off)
 };
 
+struct eviction_set_t {
+	char *victim;
+	cache_block_t *set;
+	int len;
+	int owned; // victim is a line of the pool, reserved for as long as the set
+};
+
+void *eviction_scratch_get(struct eviction_scratch_t *s, int i, size_t size);
+void eviction_scratch_free(struct eviction_scratch_t *s);
+
+int gt_eviction(cache_block_t **ptr, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+int gt_eviction_array(cache_block_t **ptr, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+
 int find_eviction_set(char *pool, unsigned long pool_sz, char *victim, struct eviction_config_t conf,
 		      cache_block_t **eviction_set);
+int find_any_eviction_set(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+			  struct eviction_set_t *out);
+int find_any_eviction_sets(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+			   struct eviction_set_t *sets, int n);
+int find_all_eviction_sets(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+			   struct eviction_set_t *sets, int max_sets);
+int expand_eviction_set(char *pool, unsigned long pool_sz, struct eviction_set_t *base, struct eviction_config_t conf,
+			struct eviction_set_t *out);
+
+/*
+ * Where expand_eviction_set_from gets lines: take links up to n free lines
+ * at a page offset and marks them in use, claim marks one line in use if it
+ * is free (0) or fails (-1), put frees a list of lines.
+ */
+struct line_source_t {
+	cache_block_t *(*take)(void *priv, unsigned long offset, int n);
+	int (*claim)(void *priv, cache_block_t *x);
+	void (*put)(void *priv, cache_block_t *set);
+	void *priv;
+};
+
+int expand_eviction_set_from(const struct line_source_t *src, struct eviction_set_t *base,
+			     struct eviction_config_t conf, struct eviction_set_t *out);
 
 #endif
@@ -0,0 +1,87 @@
+#include "hist.h"
+
+#include <math.h>
+#include <string.h>
+
+void
+hist_init(struct histogram_t *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = HIST_MAX;
+}
+
+void
+hist_add(struct histogram_t *hist, size_t val)
+{
+	if (val >= HIST_MAX) {
+		// remove outliers
+		hist->overflow++;
+		return;
+	}
+	hist->bins[val]++;
+	hist->n++;
+	hist->sum += val;
+	hist->sumsq += (uint64_t)val * val;
+	if ((int)val < hist->min) {
+		hist->min = val;
+	}
+	if ((int)val > hist->max) {
+		hist->max = val;
+	}
+	if (hist->bins[val] > hist->bins[hist->mode]) {
+		hist->mode = val;
+	}
+}
+
+float
+hist_avg(struct histogram_t *hist)
+{
+	return hist->n ? (float)hist->sum / hist->n : 0;
+}
+
+int
+hist_mode(struct histogram_t *hist)
+{
+	return hist->n ? hist->mode : 0;
+}
+
+int
+hist_min(struct histogram_t *hist)
+{
+	return hist->n ? hist->min : 0;
+}
+
+int
+hist_max(struct histogram_t *hist)
+{
+	return hist->max;
+}
+
+double
+hist_variance(struct histogram_t *hist)
+{
+	double mean;
+	if (!hist->n) {
+		return 0;
+	}
+	mean = (double)hist->sum / hist->n;
+	return (double)hist->sumsq / hist->n - mean * mean;
+}
+
+double
+hist_std(struct histogram_t *hist)
+{
+	double var = hist_variance(hist);
+	return var > 0 ? sqrt(var) : 0;
+}
+
+// count number of misses
+int
+hist_q(struct histogram_t *hist, int threshold)
+{
+	int i, count = 0;
+	for (i = threshold < 0 ? 0 : threshold + 1; i < HIST_MAX; i++) {
+		count += hist->bins[i];
+	}
+	return count;
+}
@@ -0,0 +1,33 @@
+#ifndef hist_H
+#define hist_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Latencies at or above this go to the overflow bucket (noisy measurements)
+#define HIST_MAX 800
+
+/*
+ * Direct-indexed cycle histogram. Count, sum, sum of squares, min, max and
+ * mode are updated on insertion, so statistics never rescan the bins.
+ */
+struct histogram_t {
+	uint32_t bins[HIST_MAX];
+	uint64_t overflow;
+	uint64_t n;
+	uint64_t sum, sumsq;
+	int min, max, mode;
+};
+
+void hist_init(struct histogram_t *hist);
+void hist_add(struct histogram_t *hist, size_t val);
+
+float hist_avg(struct histogram_t *hist);
+int hist_mode(struct histogram_t *hist);
+int hist_min(struct histogram_t *hist);
+int hist_max(struct histogram_t *hist);
+double hist_variance(struct histogram_t *hist);
+double hist_std(struct histogram_t *hist);
+int hist_q(struct histogram_t *hist, int threshold);
+
+#endif /* hist_H */
@@ -1,4 +1,5 @@
 #include "list_utils.h"
+#include "rng.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -151,7 +152,10 @@ initialize_list(cache_block_t *src, unsigned long sz)
 /**
  * Randomly selects n elements from a set of cache blocks and re-links them into a new list.
  * This function assumes the set is initially laid out in an array with a specified stride between elements.
- * 
+ * The first block always heads the list; the other n - 1 are drawn among the blocks still free
+ * (set == -2) with Floyd's algorithm, so only O(n) random numbers and memory are needed however
+ * large the set is. Blocks found in use are replaced by random probes, then by a sweep.
+ *
  * @param set Pointer to the array of cache blocks.
  * @param stride Distance (in bytes) between consecutive cache blocks in the array.
  * @param set_size Total size (in bytes) of the array containing the cache blocks.
@@ -160,37 +164,62 @@ initialize_list(cache_block_t *src, unsigned long sz)
 void
 pick_n_random_from_list(cache_block_t *set, unsigned long stride, unsigned long set_size, unsigned long n)
 {
-	unsigned int num_blocks = set_size / stride; // Calculate number of blocks in the set.
-	cache_block_t *current_block = set;
+	unsigned long num_blocks = set_size / stride; // Calculate number of blocks in the set.
+	unsigned long step = stride / sizeof(cache_block_t), m = num_blocks - 1, k = 0, i, j;
+	cache_block_t *current_block = set, *b, **picked;
+
 	current_block->prev = NULL; // Initialize the first block.
 	current_block->set = -1;
+	current_block->next = NULL;
 
-	// Allocate an array to hold block indices for random selection.
-	unsigned long *indices = (unsigned long *)calloc(num_blocks, sizeof(unsigned long));
-	for (unsigned int i = 0; i < num_blocks; i++) {
-		indices[i] = i * (stride / sizeof(cache_block_t)); // Calculate proper index based on stride.
+	if (n > num_blocks) {
+		n = num_blocks;
 	}
-
-	// Shuffle indices using the Fisher-Yates algorithm.
-	for (unsigned int i = 0; i < num_blocks - 1; i++) {
-		size_t rand_index = i + rand() / (RAND_MAX / (num_blocks - i) + 1);
-		unsigned long temp = indices[rand_index];
-		indices[rand_index] = indices[i];
-		indices[i] = temp;
+	if (n < 2 || !(picked = (cache_block_t **)malloc((n - 1) * sizeof(cache_block_t *)))) {
+		return;
 	}
 
-	// Link n randomly selected blocks.
-	unsigned int selected_count = 1; // Start with 1 to account for the initial block.
-	for (unsigned int i = 0; i < num_blocks && selected_count < n; i++) {
-		if (set[indices[i]].set == -2) { // Check if the block is eligible for selection.
-			current_block->next = &set[indices[i]]; // Link the block.
-			set[indices[i]].prev = current_block;
-			set[indices[i]].set = -1;
-			current_block = current_block->next;
-			selected_count++;
+	// Floyd: n - 1 distinct blocks among 1..num_blocks-1, a taken draw falls back to the fresh j
+	for (j = m - (n - 1); j < m; j++) {
+		b = &set[(1 + rng_range(j + 1)) * step];
+		if (b->set != -2) {
+			b = &set[(1 + j) * step];
+		}
+		if (b->set == -2) {
+			b->set = -1;
+			picked[k++] = b;
+		}
+	}
+	for (i = 0; k < n - 1 && i < 4 * n; i++) {
+		b = &set[(1 + rng_range(m)) * step];
+		if (b->set == -2) {
+			b->set = -1;
+			picked[k++] = b;
 		}
 	}
+	for (i = 1; k < n - 1 && i < num_blocks; i++) {
+		b = &set[i * step];
+		if (b->set == -2) {
+			b->set = -1;
+			picked[k++] = b;
+		}
+	}
+
+	// Floyd's output is not in random order
+	for (i = 0; i + 1 < k; i++) {
+		j = i + rng_range(k - i);
+		b = picked[j];
+		picked[j] = picked[i];
+		picked[i] = b;
+	}
+
+	// Link the selected blocks.
+	for (i = 0; i < k; i++) {
+		current_block->next = picked[i];
+		picked[i]->prev = current_block;
+		current_block = picked[i];
+	}
 
-	free(indices); // Free the allocated indices array.
+	free(picked);
 	current_block->next = NULL; // Mark the end of the list.
 }
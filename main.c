@@ -1,6 +1,21 @@
 #include "cache.h"
 #include "eviction.h"
 #include "list_utils.h"
+#include "oracle.h"
+#include "sim.h"
+#include "rng.h"
+#include "parallel.h"
+#include "timer.h"
+#include "reduction.h"
+#include "traversal.h"
+#include "ctx.h"
+#include "pagemap.h"
+#include "slicehash.h"
+#include "classify.h"
+#include "physical.h"
+#include "trace.h"
+#include "pool.h"
+#include "store.h"
 
 #include <assert.h>
 #include <fcntl.h>
@@ -20,200 +35,235 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-#define NUM_MASKS 64
+#define MAX_VICTIMS (1 << 13) // 512MB of victims
 
-uint64_t
-read_from_pagemap(void *virutal_address)
-{
-	int pagemap_fd;
-	uint64_t paddr = 0;
-	off_t offset;
-	ssize_t bytes_read;
-	const size_t pagemap_entry_size = sizeof(uint64_t);
-	uint64_t vaddr = (uint64_t)virutal_address;
-	unsigned long page_offset = vaddr % sysconf(_SC_PAGESIZE); // Calculate the offset within the page
-
-	pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
-	if (pagemap_fd < 0) {
-		perror("open pagemap");
-		return 0;
-	}
+static struct pagemap_t pagemap = { .fd = -1 };
+static struct slice_fn_t slice_fn;
+static struct trace_t trace;
 
-	// Calculate the offset for the virtual address in the pagemap file
-	offset = (vaddr / sysconf(_SC_PAGESIZE)) * pagemap_entry_size;
+// Every eviction set found or loaded, for --save and --export
+static struct eviction_set_t *kept;
+static int nkept, kept_max;
 
-	if (lseek(pagemap_fd, offset, SEEK_SET) == (off_t)-1) {
-		perror("lseek pagemap");
-		close(pagemap_fd);
-		return 0;
+static void
+keep(const struct eviction_set_t *es)
+{
+	if (!es->set) {
+		return;
 	}
-
-	bytes_read = read(pagemap_fd, &paddr, pagemap_entry_size);
-	if (bytes_read < 0) {
-		perror("read pagemap");
-		close(pagemap_fd);
-		return 0;
+	if (nkept == kept_max) {
+		struct eviction_set_t *p = realloc(kept, (kept_max * 2 + 64) * sizeof(*kept));
+		if (!p) {
+			return;
+		}
+		kept = p;
+		kept_max = kept_max * 2 + 64;
 	}
-
-	close(pagemap_fd);
-
-	// Extract the physical page frame number and calculate the physical address
-	paddr = paddr & ((1ULL << 55) - 1); // Mask out the flag bits
-	paddr = paddr * sysconf(_SC_PAGESIZE); // Convert page frame number to physical address
-	paddr += page_offset; // Add the offset within the page
-
-	return paddr;
+	kept[nkept++] = *es;
 }
 
-// Function to XOR selected bits of an address based on a bitmask
-uint8_t
-xor_selected_bits(uint64_t address, uint64_t bitmask)
+static void
+print_eviction_set(cache_block_t *ptr, struct sim_t *sim)
 {
-	uint8_t result = 0;
+	int i, n = list_length(ptr);
+	void **lines = (void **)malloc(n * sizeof(void *));
+	uint64_t *paddrs = (uint64_t *)malloc(n * sizeof(uint64_t));
+	uint32_t *sets = (uint32_t *)malloc(n * sizeof(uint32_t));
+	uint16_t *slices = (uint16_t *)malloc(n * sizeof(uint16_t));
+
+	if (n && (!lines || !paddrs || !sets || !slices)) {
+		goto out;
+	}
+	for (i = 0; i < n; i++, ptr = ptr->next) {
+		lines[i] = ptr;
+	}
+	if (!sim) {
+		pagemap_translate_bulk(&pagemap, lines, paddrs, n);
+		classify_bulk(&slice_fn, paddrs, n, sets, slice_fn.slices ? slices : NULL);
+	}
 
-	for (uint64_t bit = 1; bit != 0; bit <<= 1) {
-		if (bitmask & bit) {
-			result ^= (address & bit) ? 1 : 0;
+	for (i = 0; i < n; i++) {
+		uint64_t paddr, slice, set_index;
+		if (sim) {
+			paddr = sim_paddr(sim, lines[i]);
+			slice = sim_slice(sim, paddr);
+			set_index = sim_set(sim, paddr);
+		} else if (paddrs[i] == PADDR_INVALID) {
+			printf("%p (not present or no access to pagemap)\n", lines[i]);
+			continue;
+		} else if (!slice_fn.slices) {
+			printf("%#lx (?/%u)\n", paddrs[i], sets[i]);
+			continue;
+		} else {
+			paddr = paddrs[i];
+			slice = slices[i];
+			set_index = sets[i];
 		}
-	}
 
-	return result;
+		printf("%#lx (%lu/%lu)\n", paddr, slice, set_index);
+	}
+	printf("\n");
+out:
+	free(lines);
+	free(paddrs);
+	free(sets);
+	free(slices);
 }
 
-uint64_t
-compute_xor_mask_result(uint64_t address, uint64_t masks[], int n)
+// With the simulator, whether every line of es maps to the victim's set and slice
+static int
+congruent(struct sim_t *sim, const struct eviction_set_t *es)
 {
-	uint64_t result_mask = 0;
+	uint64_t v = sim_paddr(sim, es->victim), p;
+	cache_block_t *x;
 
-	for (int i = 0; i < n; ++i) {
-		// Apply xor_selected_bits for each mask and set the bit in result_mask accordingly
-		if (xor_selected_bits(address, masks[i])) {
-			result_mask |= (uint64_t)1 << i;
+	if (!es->set) {
+		return 0;
+	}
+	for (x = es->set; x; x = x->next) {
+		p = sim_paddr(sim, x);
+		if (sim_set(sim, p) != sim_set(sim, v) || sim_slice(sim, p) != sim_slice(sim, v)) {
+			return 0;
 		}
 	}
-
-	return result_mask;
+	return 1;
 }
 
-// Function to check if XOR of selected bits is consistent across a set of addresses
-bool
-check_xor_consistency(uint64_t addresses[], size_t n, uint64_t bitmask)
+static int
+translate_sim(void *priv, void *const *addrs, uint64_t *paddrs, int n)
 {
-	if (n == 0) {
-		return true;
+	for (int i = 0; i < n; i++) {
+		paddrs[i] = sim_paddr((struct sim_t *)priv, addrs[i]);
 	}
-
-	// Get initial XOR result for comparison
-	uint8_t initial_result = xor_selected_bits(addresses[0], bitmask);
-
-	for (size_t i = 1; i < n; ++i) {
-		uint8_t current_result = xor_selected_bits(addresses[i], bitmask);
-
-		// If any address yields a different result, the XOR is not consistent
-		if (current_result != initial_result) {
-			return false;
-		}
-	}
-
-	return true;
+	return n;
 }
 
-// Function to generate and print all possible bitmasks within a specified bit range
-void
-generate_bitmasks(uint32_t start_bit, uint32_t end_bit)
+static int
+translate_pagemap(void *priv, void *const *addrs, uint64_t *paddrs, int n)
 {
-	if (start_bit > end_bit || end_bit >= 64) {
-		printf("Invalid bit range.\n");
-		return;
-	}
-
-	uint32_t num_bits = end_bit - start_bit + 1;
-	uint64_t total_combinations = (uint64_t)1 << num_bits; // 2^num_bits
-
-	printf("Generating all possible bitmasks for bits %u to %u (inclusive):\n", start_bit, end_bit);
-
-	for (uint64_t i = 0; i < total_combinations; i++) {
-		uint64_t bitmask = i << start_bit; // Shift to correct position within the 64-bit address
-		printf("0x%016lx\n", bitmask);
-	}
+	return pagemap_translate_bulk((struct pagemap_t *)priv, addrs, paddrs, n);
 }
 
-// Function to identify and print all bitmasks that are consistent across a set of addresses
-void
-find_consistent_bitmasks(uint64_t addresses[], size_t n, uint32_t start_bit, uint32_t end_bit)
+/*
+ * Recovers the slice hash from the physical addresses of verified eviction
+ * sets, and prints it like the mask table in classify.c. Returns 0 if the
+ * expected number of masks was found (and, with the simulator, they match
+ * its hash), 1 otherwise.
+ */
+static int
+recover_slice_hash(struct eviction_set_t *sets, int n, struct eviction_config_t *conf, struct sim_t *sim)
 {
-	if (start_bit > end_bit || end_bit >= 64) {
-		printf("Invalid bit range.\n");
-		return;
+	struct slicehash_t h;
+	uint64_t masks[SLICEHASH_MAX_MASKS], *paddrs;
+	void **lines;
+	int i, j, k, dim, lo = 6, expected = 0;
+
+	// Bits of the line offset and the set index are shared by congruent lines
+	for (i = conf->cache_size / (64 * conf->cache_way * conf->cache_slices); i > 1; i >>= 1) {
+		lo++;
+	}
+	for (i = conf->cache_slices; i > 1; i >>= 1) {
+		expected++;
 	}
-	uint32_t num_bits = end_bit - start_bit + 1;
-	uint64_t total_combinations = (uint64_t)1 << num_bits; // 2^num_bits
-
-	// Counter for the number of consistent bitmasks found
-	uint64_t consistent_count = 0;
 
-	for (uint64_t i = 0; i < total_combinations; i++) {
-		uint64_t bitmask = i << start_bit; // Shift to correct position
-		if (check_xor_consistency(addresses, n, bitmask)) {
-			printf("Consistent bitmask: 0x%016lx\n", bitmask);
-			consistent_count++;
+	slicehash_init(&h, lo);
+	for (i = 0; i < n; i++) {
+		lines = (void **)malloc((sets[i].len + 1) * sizeof(void *));
+		paddrs = (uint64_t *)malloc((sets[i].len + 1) * sizeof(uint64_t));
+		if (!lines || !paddrs) {
+			free(lines);
+			free(paddrs);
+			return 1;
+		}
+		lines[0] = sets[i].victim;
+		for (k = 1, j = 0; j < sets[i].len; j++, k++) {
+			lines[k] = j ? ((cache_block_t *)lines[k - 1])->next : sets[i].set;
 		}
+		for (j = 0; j < k; j++) {
+			paddrs[j] = sim ? sim_paddr(sim, lines[j]) : PADDR_INVALID;
+		}
+		if (!sim) {
+			pagemap_translate_bulk(&pagemap, lines, paddrs, k);
+		}
+		slicehash_add_set(&h, paddrs, k);
+		free(lines);
+		free(paddrs);
 	}
 
-	// Print the total number of consistent bitmasks found
-	printf("Total consistent bitmasks found: %lu\n", consistent_count);
-}
-
-unsigned int
-count_bits(uint64_t n)
-{
-	unsigned int count = 0;
-	while (n)
-	{
-		n &= (n-1) ;
-		count++;
+	dim = slicehash_solve(&h, masks, SLICEHASH_MAX_MASKS);
+	printf("[+] Slice hash: %d masks from %d sets (bits %d and up, %d differences)\n", dim, n, lo, h.nrows);
+	if (dim != expected) {
+		printf("[!] Error: expected %d masks, %s\n", expected,
+		       dim > expected ? "more eviction sets are needed" : "hash is not linear");
+	}
+	slicehash_print(masks, dim < SLICEHASH_MAX_MASKS ? dim : SLICEHASH_MAX_MASKS);
+	if (dim != expected) {
+		return 1;
 	}
-	return count;
-}
 
-unsigned int
-nbits(uint64_t n)
-{
-	unsigned int ret = 0;
-	n = n >> 1;
-	while (n > 0)
-	{
-		n >>= 1;
-		ret++;
+	if (sim && dim <= SLICEHASH_MAX_MASKS) {
+		// Same span as the simulated masks above lo
+		uint64_t all[2 * SLICEHASH_MAX_MASKS], keep = ~((1ULL << lo) - 1);
+		for (i = 0; i < sim->conf.nmasks; i++) {
+			all[i] = sim->conf.masks[i] & keep;
+		}
+		for (j = 0; j < dim; j++) {
+			all[i + j] = masks[j];
+		}
+		int match = slicehash_rank(all, i) == dim && slicehash_rank(all, i + dim) == dim;
+		printf("[%c] Slice hash %s the simulator\n", match ? '+' : '!', match ? "matches" : "does not match");
+		return !match;
 	}
-	return ret;
+	return 0;
 }
 
-uint64_t
-ptos(uint64_t paddr, uint64_t slices)
+static void
+usage(char *name)
 {
-	unsigned long long ret = 0;
-	unsigned long long mask[3] = {0x1b5f575440ULL, 0x2eb5faa880ULL, 0x3cccc93100ULL}; // according to Maurice et al.
-	int bits = nbits(slices) - 1;
-	switch (bits)
-	{
-		case 3:
-			ret = (ret << 1) | (unsigned long long)(count_bits(mask[2] & paddr) % 2);
-		case 2:
-			ret = (ret << 1) | (unsigned long long)(count_bits(mask[1] & paddr) % 2);
-		case 1:
-			ret = (ret << 1) | (unsigned long long)(count_bits(mask[0] & paddr) % 2);
-		default:
-		break;
-	}
-	return ret;
+	printf("[?] Usage: %s [flags] [params]\n\n"
+	       "\tFlags:\n"
+	       "\t\t--simulate\t(use the software cache simulator as oracle)\n"
+	       "\t\t--array\t\t(array/index-based candidate set for the reduction)\n"
+	       "\t\t--conflictset\t(reduce from the conflict set of the initial buffer)\n"
+	       "\t\t--findallcolors\t(eviction sets for every color at the page offset)\n"
+	       "\t\t--slicehash\t(recover the slice hash from the sets of --findallcolors)\n"
+	       "\t\t--physical\t(--findallcolors from physical addresses, confirmed by timing)\n"
+	       "\t\t--expand\t(derive the eviction sets of the other 63 line offsets)\n"
+	       "\tParams:\n"
+	       "\t\t-b N\t\tnumber of lines in initial buffer (default: 8192)\n"
+	       "\t\t-t N\t\tthreshold in cycles (default: calibrates)\n"
+	       "\t\t-c N\t\tcache size in MB (default: 12)\n"
+	       "\t\t-s N\t\tnumber of cache slices (default: 6)\n"
+	       "\t\t-n N\t\tcache associativity (default: 16)\n"
+	       "\t\t-o N\t\tstride for blocks in bytes (default: 4096)\n"
+	       "\t\t-a n|o|g|b|l\tsearch algorithm, l finds any eviction set (default: 'g')\n"
+	       "\t\t-e N|R,W,S[,B]\teviction strategy: 0-haswell, 1-skylake, 2-simple, 3-skylake-fb, 4-haswell-fb,\n"
+	       "\t\t\t\tor R repeats of a W line window sliding by S, B to walk back (default: 2)\n"
+	       "\t\t-r N\t\tnumber of rounds per test (default: 10)\n"
+	       "\t\t--threads N\tsearch in parallel on N pinned threads, one per physical core\n"
+	       "\t\t--victims N\tnumber of victims, 64KB apart (default: 1)\n"
+	       "\t\t--timer T\trdtsc|rdtscp|counter (default: rdtsc, counter if built with THREAD_COUNTER)\n"
+	       "\t\t--policy P\tsimulated replacement: lru|plru|qlru (default: lru)\n"
+	       "\t\t--noise P\tsimulated measurement error probability (default: 0)\n"
+	       "\t\t--sprt E\tstop each test once decided with error rate E (default: average -r rounds)\n"
+	       "\t\t--calconf P\tstop calibrating at this confidence, 0 runs all rounds (default: 0.99)\n"
+	       "\t\t--calcache F\treuse thresholds cached in file F until they drift\n"
+	       "\t\t--seed N\trandom seed, for reproducible runs (default: current time)\n"
+	       "\t\t--trace F\twrite phase records as JSON lines to F (default: printed)\n"
+	       "\t\t--perf\t\tcount LLC misses during tests with perf_event_open\n"
+	       "\t\t--nohugepages\tmap the pool with 4KB pages\n"
+	       "\t\t--hugetlbfs F\tmap the pool from file F on hugetlbfs, kept across runs\n"
+	       "\t\t--save F\tsave the eviction sets found to F\n"
+	       "\t\t--load F\tload and revalidate the eviction sets in F instead of searching\n"
+	       "\t\t--export F\twrite the eviction sets as text to F\n"
+	       "\t\t-h\t\tshow this help\n",
+	       name);
 }
 
 int
-main()
+main(int argc, char **argv)
 {
-	int seed = time(NULL);
-	srand(seed);
+	uint64_t seed = time(NULL);
 
 	struct eviction_config_t conf = {
 		.rounds = 10,
@@ -223,46 +273,479 @@ main()
 		.cache_way = 16,
 		.cache_slices = 6,
 		.initial_set_size = 8192,
+		.cal_confidence = 0.99,
 	};
 
-	char *buffer = (char *)mmap(NULL, 1 << 30, PROT_READ | PROT_WRITE,
-				    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
-	if (buffer == MAP_FAILED) {
-		printf("[!] Error: Memory allocation failed\n");
+	const char *trace_file = NULL, *pool_file = NULL, *save_file = NULL, *load_file = NULL, *export_file = NULL;
+	FILE *trace_out = NULL;
+	int perf = 0, nohuge = 0;
+	int status = 0, simulate = 0, find_all = 0, slice_hash = 0, physical = 0, expand = 0, threads = 0, nvictims = 1, option = 0, option_index = 0;
+	enum sim_policy policy = SIM_LRU;
+	double noise = 0;
+	struct sim_config_t sim_conf;
+	struct sim_t sim;
+	struct oracle_t oracle;
+	int t;
+	enum timer_kind timer = timer_kind;
+	struct traversal_t traversal;
+
+	static struct option long_options[] = {
+		{ "simulate", no_argument, 0, 'S' },
+		{ "policy", required_argument, 0, 'P' },
+		{ "noise", required_argument, 0, 'N' },
+		{ "calconf", required_argument, 0, 'K' },
+		{ "sprt", required_argument, 0, 'Q' },
+		{ "array", no_argument, 0, 'A' },
+		{ "conflictset", no_argument, 0, 'X' },
+		{ "findallcolors", no_argument, 0, 'L' },
+		{ "slicehash", no_argument, 0, 'H' },
+		{ "physical", no_argument, 0, 'Y' },
+		{ "expand", no_argument, 0, 'E' },
+		{ "threads", required_argument, 0, 'T' },
+		{ "timer", required_argument, 0, 'M' },
+		{ "victims", required_argument, 0, 'V' },
+		{ "calcache", required_argument, 0, 'F' },
+		{ "seed", required_argument, 0, 'R' },
+		{ "trace", required_argument, 0, 'J' },
+		{ "perf", no_argument, 0, 'U' },
+		{ "nohugepages", no_argument, 0, 'G' },
+		{ "hugetlbfs", required_argument, 0, 'W' },
+		{ "save", required_argument, 0, 'D' },
+		{ "load", required_argument, 0, 'I' },
+		{ "export", required_argument, 0, 'Z' },
+		{ "help", no_argument, 0, 'h' },
+		{ 0, 0, 0, 0 },
+	};
+
+	while ((option = getopt_long(argc, argv, "b:t:c:s:n:o:a:e:r:h", long_options, &option_index)) != -1) {
+		switch (option) {
+		case 'b':
+			conf.initial_set_size = atoi(optarg);
+			break;
+		case 't':
+			conf.threshold = atoi(optarg);
+			break;
+		case 'c':
+			conf.cache_size = atoi(optarg) << 20;
+			break;
+		case 's':
+			conf.cache_slices = atoi(optarg);
+			break;
+		case 'n':
+			conf.cache_way = atoi(optarg);
+			break;
+		case 'o':
+			conf.stride = atoi(optarg);
+			break;
+		case 'a':
+			conf.algorithm = optarg[0];
+			if (conf.algorithm != 'l' && !reduction_find(conf.algorithm)) {
+				printf("[!] Error: unknown algorithm %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			if (traversal_parse(optarg, &traversal, &conf.traversal)) {
+				printf("[!] Error: unknown eviction strategy %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'r':
+			conf.rounds = atoi(optarg);
+			break;
+		case 'S':
+			simulate = 1;
+			break;
+		case 'P':
+			if (sim_parse_policy(optarg, &policy)) {
+				printf("[!] Error: unknown policy %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'N':
+			noise = atof(optarg);
+			break;
+		case 'K':
+			conf.cal_confidence = atof(optarg);
+			break;
+		case 'F':
+			conf.cal_cache = optarg;
+			break;
+		case 'Q':
+			conf.test_error = atof(optarg);
+			break;
+		case 'A':
+			conf.engine = ENGINE_ARRAY;
+			break;
+		case 'X':
+			conf.conflict_set = 1;
+			break;
+		case 'L':
+			find_all = 1;
+			break;
+		case 'H':
+			find_all = 1;
+			slice_hash = 1;
+			break;
+		case 'Y':
+			find_all = 1;
+			physical = 1;
+			break;
+		case 'E':
+			expand = 1;
+			break;
+		case 'T':
+			threads = atoi(optarg);
+			break;
+		case 'V':
+			nvictims = atoi(optarg);
+			break;
+		case 'M':
+			if (timer_parse(optarg, &timer)) {
+				printf("[!] Error: unknown timer %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'R':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'J':
+			trace_file = optarg;
+			break;
+		case 'U':
+			perf = 1;
+			break;
+		case 'G':
+			nohuge = 1;
+			break;
+		case 'W':
+			pool_file = optarg;
+			break;
+		case 'D':
+			save_file = optarg;
+			break;
+		case 'I':
+			load_file = optarg;
+			break;
+		case 'Z':
+			export_file = optarg;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return option != 'h';
+		}
+	}
+
+	// Victims are 64KB apart in their own mapping
+	if (nvictims < 1 || nvictims > MAX_VICTIMS) {
+		printf("[!] Error: --victims must be between 1 and %d\n", MAX_VICTIMS);
 		return 1;
 	}
 
-	// Consider the first 128MB as pool
-	unsigned long long pool_sz = 256 << 20;
-	char *pool = (char *)&buffer[1 << 29];
+	// Only a power of two slices is selected by XORs of address bits
+	if (slice_hash && (conf.cache_slices & (conf.cache_slices - 1))) {
+		printf("[!] Error: %d slices use a non-linear hash, --slicehash cannot recover it\n",
+		       conf.cache_slices);
+		return 1;
+	}
 
-	for (uint64_t i = 0; i < 1; i++) {
-		char *victim = &buffer[i * (1 << 16)];
+	if (conf.algorithm == 'l' && (threads > 0 || find_all)) {
+		printf("[!] Error: -a l cannot be combined with --threads or --findallcolors\n");
+		return 1;
+	}
+
+	rng_seed(seed);
+	printf("[+] Seed: %llu\n", (unsigned long long)seed);
+
+	if (simulate) {
+		sim_default_config(&sim_conf, &conf);
+		sim_conf.policy = policy;
+		sim_conf.noise = noise;
+		sim_conf.seed = seed;
+		if (sim_init(&sim, &sim_conf)) {
+			printf("[!] Error: invalid simulator geometry\n");
+			return 1;
+		}
+		sim_oracle_init(&oracle, &sim);
+		printf("[+] Simulated LLC: %d sets x %d ways x %d slices\n", sim_conf.sets, sim_conf.ways,
+		       sim_conf.slices);
+	} else {
+		oracle_hw_init(&oracle);
+		pagemap_open(&pagemap);
+		int sets = conf.cache_size / (64 * conf.cache_way * conf.cache_slices);
+		if (slice_fn_default(&slice_fn, conf.cache_slices, sets)) {
+			// Non-power-of-two parts hash through a lookup table that is not known here
+			if (physical) {
+				printf("[!] Error: --physical needs the slice lookup table of this %d-slice part, "
+				       "which is not known (only power of two slice counts have a default hash)\n",
+				       conf.cache_slices);
+				return 1;
+			}
+			slice_fn.slices = 0;
+			slice_fn.sets = sets;
+			printf("[!] Warning: no slice lookup table for %d slices, printing set indexes only\n",
+			       conf.cache_slices);
+		}
+		if (timer_init(timer, -1)) {
+			printf("[!] Error: could not start %s timer\n", timer_name(timer));
+			return 1;
+		}
+		printf("[+] Timer: %s\n", timer_name(timer));
+	}
+	conf.oracle = &oracle;
+	printf("[+] Eviction strategy: %s\n", traversal_name(conf.traversal));
+
+	if (trace_file && !(trace_out = fopen(trace_file, "w"))) {
+		printf("[!] Error: could not write %s\n", trace_file);
+		return 1;
+	}
+	if (trace_init(&trace, trace_out ? trace_json : trace_print, trace_out, perf && !simulate)) {
+		printf("[!] Error: perf_event_open failed, LLC misses are not counted\n");
+	}
+	conf.trace = &trace;
+
+	// Victims 64KB apart, then the pool (one per thread), sized from the cache geometry
+	unsigned long victims_sz = ((unsigned long)nvictims << 16) + (2 << 20) - 1;
+	victims_sz -= victims_sz % (2 << 20);
+	unsigned long pool_sz = pool_size(&conf) * (threads > 0 ? threads : 1);
 
-		cache_block_t *eviction_set = NULL;
+	// Timing needs hugepages, the simulator maps its own frames
+	struct pool_t mem;
+	if (pool_open(&mem, victims_sz + pool_sz, pool_file,
+		      simulate || nohuge ? POOL_NOHUGE : POOL_POPULATE | POOL_LOCK)) {
+		printf("[!] Error: Memory allocation failed\n");
+		return 1;
+	}
+	char *buffer = mem.base;
+	char *pool = &buffer[victims_sz];
+	pool_sz = mem.size - victims_sz;
+	printf("[+] Pool: %lu MB of %s pages at %p%s%s\n", pool_sz >> 20, pool_kind_name(mem.kind), (void *)pool,
+	       mem.locked ? ", locked" : "", pool_file ? (mem.created ? ", new file" : ", reused file") : "");
+
+	translate_fn translate = simulate ? translate_sim : pagemap.fd >= 0 ? translate_pagemap : NULL;
+	void *translate_priv = simulate ? (void *)&sim : (void *)&pagemap;
+	struct eviction_set_t *loaded = NULL;
+
+	if (load_file) {
+		int n = store_load(load_file, mem.base, mem.size, &conf, &loaded, translate, translate_priv);
+		int *valid = (int *)calloc(n > 0 ? n : 1, sizeof(int));
+		struct timespec t0, t1;
+		if (n < 0 || !valid) {
+			return 1;
+		}
+		if (conf.threshold <= 0) {
+			conf.threshold = oracle_calibrate(conf.oracle, pool, &conf);
+			printf("[+] Calibrated Threshold = %d\n", conf.threshold);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		int ok = store_validate(&conf, loaded, n, translate, translate_priv, valid);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (ok < 0) {
+			printf("[!] Error: Memory allocation failed\n");
+			return 1;
+		}
+		printf("[+] Loaded %d eviction sets from %s, %d still valid (%.3f ms)\n", n, load_file, ok,
+		       (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+		for (int i = 0; i < n; i++) {
+			if (!valid[i]) {
+				printf("[!] (ID=%d) Eviction set for %p no longer valid\n", i, (void *)loaded[i].victim);
+				continue;
+			}
+			printf("[+] (ID=%d) Eviction set for %p (length=%d): \n", i, (void *)loaded[i].victim,
+			       loaded[i].len);
+			print_eviction_set(loaded[i].set, simulate ? &sim : NULL);
+			keep(&loaded[i]);
+		}
+		free(valid);
+	} else if (threads > 0) {
+		// Threads split the pool between them
+		struct parallel_result_t *results = calloc(nvictims, sizeof(*results));
+		struct oracle_t *oracles = calloc(threads, sizeof(*oracles));
+		struct sim_t *sims = calloc(threads, sizeof(*sims));
+		char **victims = calloc(nvictims, sizeof(char *));
+		if (!results || !oracles || !sims || !victims) {
+			printf("[!] Error: Memory allocation failed\n");
+			return 1;
+		}
+		for (int i = 0; i < nvictims; i++) {
+			victims[i] = &buffer[i * (1 << 16)];
+		}
+		for (t = 0; t < threads; t++) {
+			if (simulate) {
+				if (sim_init(&sims[t], &sim_conf)) {
+					printf("[!] Error: invalid simulator geometry\n");
+					return 1;
+				}
+				sim_oracle_init(&oracles[t], &sims[t]);
+			} else {
+				oracle_hw_init(&oracles[t]);
+			}
+		}
 
-		if (find_eviction_set(pool, pool_sz, victim, conf, &eviction_set) || !eviction_set) {
+		int found = find_eviction_sets_parallel(pool, pool_sz, victims, nvictims, conf, threads,
+							NULL, oracles, seed, results);
+		for (int i = 0; i < nvictims; i++) {
+			printf("[+] (ID=%d, cpu=%d) %s eviction set for %p (length=%d): \n", i, results[i].cpu,
+			       results[i].ret ? "No" : "Found minimal", (void *)results[i].victim, results[i].len);
+			for (int j = 0; j < results[i].len; j++) {
+				results[i].lines[j]->next = j + 1 < results[i].len ? results[i].lines[j + 1] : NULL;
+			}
+			print_eviction_set(results[i].len ? results[i].lines[0] : NULL, simulate ? &sim : NULL);
+			if (!results[i].ret && results[i].len) {
+				struct eviction_set_t es = { results[i].victim, results[i].lines[0], results[i].len, 0 };
+				keep(&es);
+			}
+			free(results[i].lines);
+		}
+		printf("[+] Found %d/%d eviction sets on %d threads\n", found, nvictims, threads);
+		for (t = 0; t < threads; t++) {
+			oracle.tests += oracles[t].tests;
+			oracle.probes += oracles[t].probes;
+			oracle.lines += oracles[t].lines;
+			if (simulate) {
+				sim_free(&sims[t]);
+			}
+		}
+		free(results);
+		free(oracles);
+		free(sims);
+		free(victims);
+	} else if (conf.algorithm == 'l') {
+		// One pool for all of them, so that no line is handed out twice
+		struct eviction_set_t *any = (struct eviction_set_t *)calloc(nvictims, sizeof(*any));
+		if (!any) {
+			printf("[!] Error: Memory allocation failed\n");
+			return 1;
+		}
+		int found = find_any_eviction_sets(pool, pool_sz, conf, any, nvictims);
+		if (found < nvictims) {
 			printf("[-] Could not find all desired eviction sets.\n");
 		}
+		for (int i = 0; i < found; i++) {
+			printf("[+] (ID=%d) Found minimal eviction set for %p (length=%d): \n", i,
+			       (void *)any[i].victim, any[i].len);
+			print_eviction_set(any[i].set, simulate ? &sim : NULL);
+			keep(&any[i]);
+		}
+		free(any);
+	} else if (find_all) {
+		int max_sets = conf.cache_size / (conf.cache_way * 64);
+		struct eviction_set_t *sets = (struct eviction_set_t *)calloc(max_sets, sizeof(*sets));
+		if (!sets) {
+			printf("[!] Error: Memory allocation failed\n");
+			return 1;
+		}
+		int found = -1;
+		if (physical) {
+			struct slice_fn_t f = slice_fn;
+			if (simulate) {
+				uint16_t table[1 << CLASSIFY_MAX_MASKS];
+				slice_fn_init(&f, sim_conf.masks, sim_conf.nmasks, sim_conf.slices, sim_conf.sets);
+				for (int h = 0; h < (1 << f.nmasks); h++) {
+					table[h] = h % f.slices; // as in sim_slice
+				}
+				slice_fn_set_table(&f, table, 1 << f.nmasks);
+			}
+			if (f.has_table) {
+				found = find_all_eviction_sets_physical(pool, pool_sz, conf, &f,
+									simulate ? translate_sim : translate_pagemap,
+									simulate ? (void *)&sim : (void *)&pagemap, sets,
+									max_sets);
+			}
+			if (found < 0) {
+				printf("[!] Error: no physical addresses, falling back to timing\n");
+			}
+		}
+		if (found < 0) {
+			found = find_all_eviction_sets(pool, pool_sz, conf, sets, max_sets);
+		}
+		for (int i = 0; i < found; i++) {
+			printf("[+] (ID=%d) Found minimal eviction set for %p (length=%d): \n", i,
+			       (void *)sets[i].victim, sets[i].len);
+			print_eviction_set(sets[i].set, simulate ? &sim : NULL);
+			keep(&sets[i]);
+		}
+		if (slice_hash && recover_slice_hash(sets, found, &conf, simulate ? &sim : NULL)) {
+			status = 1;
+		}
+		free(sets);
+	}
 
-		printf("[+] Found minimal eviction set for %p (length=%d): \n", (void *)victim,
-		       list_length(eviction_set));
+	struct evsets_ctx *ctx = NULL;
+	if (!load_file && !find_all && threads <= 0 && conf.algorithm != 'l') {
+		// One context for all victims: calibrate and set up the pool once
+		ctx = ctx_create(pool, pool_sz, conf, seed);
+		if (!ctx) {
+			printf("[!] Error: could not set up search context\n");
+			return 1;
+		}
+		conf.threshold = ctx_threshold(ctx);
+	}
 
-		cache_block_t *ptr = eviction_set;
-		while (ptr != NULL) {
-			uint64_t set_index = extract_bits((uint64_t)ptr, 11, 6);
-			// assert(set_index == 0);
+	for (uint64_t i = 0; ctx && i < (uint64_t)nvictims; i++) {
+		char *victim = &buffer[i * (1 << 16)];
 
-			uint64_t paddr = read_from_pagemap((void*)ptr);
-			uint64_t slice = ptos(paddr, 6);
+		struct eviction_set_t es;
 
-			printf("%#lx (%lu/%lu)\n", paddr, slice, set_index);
+		if (ctx_find(ctx, victim, &es)) {
+			printf("[-] Could not find all desired eviction sets.\n");
+		}
+		keep(&es);
+
+		printf("[+] Found minimal eviction set for %p (length=%d): \n", (void *)victim, es.len);
+		print_eviction_set(es.set, simulate ? &sim : NULL);
+
+		if (expand && es.set) {
+			struct eviction_set_t offsets[4096 / 64];
+			int valid = 0;
+			ctx_expand(ctx, &es, offsets);
+			for (int k = 0; k < 4096 / 64; k++) {
+				printf("[+] (offset=%d) Eviction set for %p (length=%d): \n", k,
+				       (void *)offsets[k].victim, offsets[k].len);
+				print_eviction_set(offsets[k].set, simulate ? &sim : NULL);
+				if (k != (int)((uintptr_t)es.victim % 4096) / 64) {
+					keep(&offsets[k]);
+				}
+				if (simulate && congruent(&sim, &offsets[k])) {
+					valid++;
+				} else if (simulate) {
+					printf("[!] Error: offset %d has no congruent eviction set\n", k);
+				}
+			}
+			if (simulate) {
+				printf("[+] Simulator: %d/%d offsets congruent\n", valid, 4096 / 64);
+			}
+		}
+	}
+	ctx_destroy(ctx);
 
-			ptr = ptr->next;
+	if (save_file) {
+		if (store_save(save_file, mem.base, mem.size, &conf, kept, nkept, translate, translate_priv)) {
+			printf("[!] Error: could not save eviction sets to %s\n", save_file);
+		} else {
+			printf("[+] Saved %d eviction sets to %s\n", nkept, save_file);
 		}
-		printf("\n");
 	}
+	if (export_file && store_export(export_file, mem.base, mem.size, &conf, kept, nkept, translate,
+					translate_priv)) {
+		printf("[!] Error: could not write %s\n", export_file);
+	}
+	free(kept);
+	free(loaded);
 
-	munmap(buffer, 1 << 30);
-	return 0;
+	printf("[+] Oracle (%s): %lu tests, %lu probes, %lu lines traversed\n", oracle.name, oracle.tests,
+	       oracle.probes, oracle.lines);
+	if (simulate) {
+		sim_free(&sim);
+	}
+
+	trace_close(&trace);
+	if (trace_out) {
+		fclose(trace_out);
+	}
+	pagemap_close(&pagemap);
+	timer_stop();
+	pool_close(&mem);
+	return status;
 }
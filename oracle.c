@@ -0,0 +1,197 @@
+#include "oracle.h"
+#include "cache.h"
+#include "list_utils.h"
+#include "trace.h"
+
+#include <stdlib.h>
+
+static int
+hw_probe(void *priv, cache_block_t *set, char *victim, const struct traversal_t *t)
+{
+	(void)priv;
+	return test_set(set, victim, t);
+}
+
+static void
+hw_probe_batch(void *priv, cache_block_t *set, char **victims, int n, int *lat, const struct traversal_t *t)
+{
+	(void)priv;
+	test_set_batch(set, victims, n, lat, t);
+}
+
+static int
+hw_calibrate(void *priv, char *victim, struct eviction_config_t *conf)
+{
+	(void)priv;
+	return calibrate(victim, conf);
+}
+
+void
+oracle_hw_init(struct oracle_t *o)
+{
+	o->name = "hw";
+	o->probe = hw_probe;
+	o->probe_batch = hw_probe_batch;
+	o->calibrate = hw_calibrate;
+	o->priv = NULL;
+	oracle_reset_stats(o);
+}
+
+void
+oracle_reset_stats(struct oracle_t *o)
+{
+	o->tests = 0;
+	o->probes = 0;
+	o->lines = 0;
+}
+
+// len < 0: unknown, counted here (a walk of set, off the hot paths)
+static void
+account(struct eviction_config_t *conf, struct oracle_t *o, cache_block_t *set, long len, int used)
+{
+	if (!o && !conf->stats && !conf->trace) {
+		return;
+	}
+	if (len < 0) {
+		len = list_length(set);
+	}
+	if (o) {
+		o->tests++;
+		o->probes += used;
+		o->lines += used * len;
+	}
+	if (conf->stats) {
+		conf->stats->tests++;
+		conf->stats->probes += used;
+		conf->stats->lines += used * len;
+	}
+	if (conf->trace) {
+		conf->trace->tests++;
+		conf->trace->lines += used * len;
+	}
+}
+
+/**
+ * Same decision rules as tests_avg and tests_sprt (conf->test_error > 0), on
+ * top of the backend probe. len is the length of set, as the reductions know
+ * it, so that counting traversed lines costs no extra walk of the list.
+ *
+ * @return 1 if the victim is evicted, otherwise 0.
+ */
+int
+oracle_test_len(struct eviction_config_t *conf, cache_block_t *set, int len, char *victim)
+{
+	struct oracle_t *o = conf->oracle;
+	int i = 0, avg = 0, delta = 0, n = 0, ret = -1;
+	size_t total = 0;
+	struct sprt_t s;
+
+	if (!o) {
+		trace_perf_enable(conf->trace);
+		if (conf->test_error > 0) {
+			ret = tests_sprt(set, victim, conf->rounds, conf->threshold, conf->test_error, &i,
+					 conf->traversal);
+		} else {
+			ret = tests_avg(set, victim, conf->rounds, conf->threshold, conf->traversal);
+			i = conf->rounds;
+		}
+		trace_perf_disable(conf->trace);
+		account(conf, o, set, len, i);
+		return ret;
+	}
+
+	if (conf->test_error > 0) {
+		sprt_init(&s, conf->test_error);
+	}
+	trace_perf_enable(conf->trace);
+	for (i = 0; i < conf->rounds && ret < 0; i++) {
+		delta = o->probe(o->priv, set, victim, conf->traversal);
+		if (delta < 800) {
+			// Otherwise, we probably have a noisy measurement
+			total += delta;
+			n++;
+			if (conf->test_error > 0) {
+				ret = sprt_add(&s, delta > conf->threshold);
+			}
+		}
+	}
+	trace_perf_disable(conf->trace);
+
+	account(conf, o, set, len, i);
+
+	if (ret < 0) {
+		avg = n ? (float)total / n : 0;
+		ret = avg > conf->threshold;
+	}
+	return ret;
+}
+
+int
+oracle_test(struct eviction_config_t *conf, cache_block_t *set, char *victim)
+{
+	return oracle_test_len(conf, set, -1, victim);
+}
+
+/**
+ * Tests up to ORACLE_MAX_BATCH victims at once, with one traversal of set per
+ * round for all of them. Each victim is decided on the average of its kept
+ * samples over conf->rounds rounds. len is the length of set, as in
+ * oracle_test_len (-1: unknown).
+ *
+ * @param evicted receives 1 for each evicted victim, otherwise 0
+ * @return number of evicted victims, or -1 if n is too large.
+ */
+int
+oracle_test_batch(struct eviction_config_t *conf, cache_block_t *set, int len, char **victims, int n,
+		  int *evicted)
+{
+	struct oracle_t *o = conf->oracle;
+	int lat[ORACLE_MAX_BATCH], kept[ORACLE_MAX_BATCH];
+	size_t total[ORACLE_MAX_BATCH];
+	int i, r, ret = 0;
+
+	if (n > ORACLE_MAX_BATCH) {
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		total[i] = 0;
+		kept[i] = 0;
+	}
+
+	trace_perf_enable(conf->trace);
+	for (r = 0; r < conf->rounds; r++) {
+		if (!o) {
+			test_set_batch(set, victims, n, lat, conf->traversal);
+		} else if (o->probe_batch) {
+			o->probe_batch(o->priv, set, victims, n, lat, conf->traversal);
+		} else {
+			for (i = 0; i < n; i++) {
+				lat[i] = o->probe(o->priv, set, victims[i], conf->traversal);
+			}
+		}
+		for (i = 0; i < n; i++) {
+			if (lat[i] < 800) {
+				total[i] += lat[i];
+				kept[i]++;
+			}
+		}
+	}
+	trace_perf_disable(conf->trace);
+
+	account(conf, o, set, len, conf->rounds);
+
+	for (i = 0; i < n; i++) {
+		evicted[i] = kept[i] && (int)((float)total[i] / kept[i]) > conf->threshold;
+		ret += evicted[i];
+	}
+	return ret;
+}
+
+int
+oracle_calibrate(struct oracle_t *o, char *victim, struct eviction_config_t *conf)
+{
+	if (!o) {
+		return calibrate(victim, conf);
+	}
+	return o->calibrate(o->priv, victim, conf);
+}
@@ -0,0 +1,46 @@
+#ifndef oracle_H
+#define oracle_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+
+#define ORACLE_MAX_BATCH 64
+
+/*
+ * Measurement oracle: answers "does traversing this list evict the victim".
+ *
+ * A backend only provides a probe, returning the victim's access latency (in
+ * cycles) after one traversal of the list with the given strategy, and a calibration routine. The
+ * decision against the threshold (average or SPRT) is shared by all backends.
+ * probe_batch is optional: it times several victims after a single traversal,
+ * and is emulated with one probe per victim if missing.
+ * A NULL oracle means the hardware path (tests_avg/tests_sprt/calibrate in
+ * cache.c).
+ */
+struct oracle_t {
+	const char *name;
+	int (*probe)(void *priv, cache_block_t *set, char *victim, const struct traversal_t *t);
+	void (*probe_batch)(void *priv, cache_block_t *set, char **victims, int n, int *lat,
+			    const struct traversal_t *t);
+	int (*calibrate)(void *priv, char *victim, struct eviction_config_t *conf);
+	void *priv;
+
+	// Counters, reset by the caller
+	unsigned long tests; // calls to oracle_test
+	unsigned long probes; // single measurements
+	unsigned long lines; // lines traversed
+};
+
+void oracle_hw_init(struct oracle_t *o);
+
+int oracle_test(struct eviction_config_t *conf, cache_block_t *set, char *victim);
+int oracle_test_len(struct eviction_config_t *conf, cache_block_t *set, int len, char *victim);
+int oracle_test_batch(struct eviction_config_t *conf, cache_block_t *set, int len, char **victims, int n,
+		      int *evicted);
+int oracle_calibrate(struct oracle_t *o, char *victim, struct eviction_config_t *conf);
+
+void oracle_reset_stats(struct oracle_t *o);
+
+#endif /* oracle_H */
@@ -0,0 +1,123 @@
+#include "pagemap.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_PFN_MASK ((1ULL << 55) - 1)
+
+/**
+ * @return 0 on success, -1 if /proc/self/pagemap cannot be opened.
+ */
+int
+pagemap_open(struct pagemap_t *pm)
+{
+	memset(pm->tags, 0, sizeof(pm->tags));
+	pm->reads = 0;
+	pm->page_size = sysconf(_SC_PAGESIZE);
+	pm->fd = open("/proc/self/pagemap", O_RDONLY);
+	if (pm->fd < 0) {
+		perror("open pagemap");
+		return -1;
+	}
+	return 0;
+}
+
+void
+pagemap_close(struct pagemap_t *pm)
+{
+	if (pm->fd >= 0) {
+		close(pm->fd);
+	}
+	pm->fd = -1;
+}
+
+// Drops cached entries, e.g. after pages were remapped
+void
+pagemap_flush(struct pagemap_t *pm)
+{
+	memset(pm->tags, 0, sizeof(pm->tags));
+}
+
+static uint64_t *
+range(struct pagemap_t *pm, unsigned long r)
+{
+	int slot = r % PAGEMAP_SLOTS;
+	ssize_t n;
+
+	if (pm->tags[slot] != r + 1) {
+		pm->reads++;
+		n = pread(pm->fd, pm->entries[slot], sizeof(pm->entries[slot]),
+			  (off_t)r * PAGEMAP_SPAN * sizeof(uint64_t));
+		if (n < 0) {
+			pm->tags[slot] = 0;
+			return NULL;
+		}
+		// Short read past the end of the address space, the rest is unmapped
+		memset((char *)pm->entries[slot] + n, 0, sizeof(pm->entries[slot]) - n);
+		pm->tags[slot] = r + 1;
+	}
+	return pm->entries[slot];
+}
+
+/**
+ * @return physical address of addr, or PADDR_INVALID if its page is not
+ * present or the frame number is not readable.
+ */
+uint64_t
+pagemap_translate(struct pagemap_t *pm, const void *addr)
+{
+	uint64_t vaddr = (uint64_t)addr, page = vaddr / pm->page_size, *entries, e;
+
+	if (pm->fd < 0 || !(entries = range(pm, page / PAGEMAP_SPAN))) {
+		return PADDR_INVALID;
+	}
+	e = entries[page % PAGEMAP_SPAN];
+	if (!(e & PAGEMAP_PRESENT) || !(e & PAGEMAP_PFN_MASK)) {
+		return PADDR_INVALID;
+	}
+	return (e & PAGEMAP_PFN_MASK) * pm->page_size + vaddr % pm->page_size;
+}
+
+struct ref_t {
+	uintptr_t addr;
+	int i;
+};
+
+static int
+by_addr(const void *a, const void *b)
+{
+	uintptr_t x = ((const struct ref_t *)a)->addr, y = ((const struct ref_t *)b)->addr;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Translates n addresses in address order, so each range of pages is read
+ * at most once per call even if ranges collide in the cache.
+ *
+ * @return number of addresses translated, the others are PADDR_INVALID.
+ */
+int
+pagemap_translate_bulk(struct pagemap_t *pm, void *const *addrs, uint64_t *paddrs, int n)
+{
+	struct ref_t *refs = (struct ref_t *)malloc(n * sizeof(*refs));
+	int i, j, ok = 0;
+
+	if (refs) {
+		for (i = 0; i < n; i++) {
+			refs[i].addr = (uintptr_t)addrs[i];
+			refs[i].i = i;
+		}
+		qsort(refs, n, sizeof(*refs), by_addr);
+	}
+	for (i = 0; i < n; i++) {
+		j = refs ? refs[i].i : i;
+		paddrs[j] = pagemap_translate(pm, addrs[j]);
+		ok += paddrs[j] != PADDR_INVALID;
+	}
+	free(refs);
+	return ok;
+}
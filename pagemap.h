@@ -0,0 +1,34 @@
+#ifndef pagemap_H
+#define pagemap_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Returned for pages that are not present or whose frame is hidden (no CAP_SYS_ADMIN)
+#define PADDR_INVALID UINT64_MAX
+
+#define PAGEMAP_SLOTS 64
+#define PAGEMAP_SPAN 512 // pages per cached range, one 2MB hugepage of 4KB pages
+
+/*
+ * Virtual to physical translation through /proc/self/pagemap. The file is
+ * opened once, and entries are read PAGEMAP_SPAN pages at a time with a
+ * single pread into a direct-mapped cache of hugepage-sized ranges, so
+ * translating the lines of many eviction sets takes a few syscalls.
+ */
+struct pagemap_t {
+	int fd;
+	long page_size;
+	unsigned long tags[PAGEMAP_SLOTS]; // range number + 1, 0 is empty
+	uint64_t entries[PAGEMAP_SLOTS][PAGEMAP_SPAN];
+	unsigned long reads; // preads issued
+};
+
+int pagemap_open(struct pagemap_t *pm);
+void pagemap_close(struct pagemap_t *pm);
+void pagemap_flush(struct pagemap_t *pm);
+
+uint64_t pagemap_translate(struct pagemap_t *pm, const void *addr);
+int pagemap_translate_bulk(struct pagemap_t *pm, void *const *addrs, uint64_t *paddrs, int n);
+
+#endif /* pagemap_H */
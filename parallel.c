@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "ctx.h"
+#include "list_utils.h"
+#include "rng.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_CPUS 1024
+
+struct worker_t {
+	pthread_t thread;
+	int id, cpu;
+	char *pool;
+	unsigned long pool_sz;
+	struct eviction_config_t conf;
+	uint64_t seed;
+
+	// Shared work queue and results, slot i is only written by its taker
+	char **victims;
+	int n;
+	int *next;
+	struct parallel_result_t *results;
+};
+
+static int
+read_int(const char *fmt, int cpu, int *val)
+{
+	char path[128];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), fmt, cpu);
+	f = fopen(path, "r");
+	if (!f) {
+		return 1;
+	}
+	ret = fscanf(f, "%d", val) != 1;
+	fclose(f);
+	return ret;
+}
+
+/**
+ * Lists one logical CPU per physical core (the first SMT sibling of each
+ * core), so measuring threads never share a core.
+ *
+ * @return number of CPUs written to cpus.
+ */
+int
+parallel_physical_cpus(int *cpus, int max)
+{
+	static int seen_core[MAX_CPUS], seen_pkg[MAX_CPUS];
+	int cpu, i, n = 0, seen = 0, core, pkg;
+	cpu_set_t allowed;
+
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+
+	for (cpu = 0; cpu < MAX_CPUS && n < max; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed)) {
+			continue;
+		}
+		if (read_int("/sys/devices/system/cpu/cpu%d/topology/core_id", cpu, &core) ||
+		    read_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu, &pkg)) {
+			// No topology information, treat every CPU as a core
+			core = cpu;
+			pkg = 0;
+		}
+		for (i = 0; i < seen; i++) {
+			if (seen_core[i] == core && seen_pkg[i] == pkg) {
+				break;
+			}
+		}
+		if (i < seen) {
+			continue;
+		}
+		seen_core[seen] = core;
+		seen_pkg[seen] = pkg;
+		seen++;
+		cpus[n++] = cpu;
+	}
+	return n;
+}
+
+static void
+save_result(struct parallel_result_t *r, cache_block_t *set)
+{
+	int i = 0;
+
+	r->len = list_length(set);
+	r->lines = (cache_block_t **)calloc(r->len ? r->len : 1, sizeof(cache_block_t *));
+	if (!r->lines) {
+		r->ret = 1;
+		r->len = 0;
+		return;
+	}
+	for (; set; set = set->next) {
+		r->lines[i++] = set;
+	}
+}
+
+static void *
+worker(void *arg)
+{
+	struct worker_t *w = (struct worker_t *)arg;
+	struct evsets_ctx *ctx = NULL;
+	cpu_set_t mask;
+	int i;
+
+	if (w->cpu >= 0) {
+		CPU_ZERO(&mask);
+		CPU_SET(w->cpu, &mask);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask)) {
+			printf("[!] Error: could not pin thread %d to cpu %d\n", w->id, w->cpu);
+		}
+	}
+	rng_seed(w->seed);
+
+	// Calibrate once per core, not per victim
+	if (w->conf.threshold <= 0) {
+		w->conf.threshold = oracle_calibrate(w->conf.oracle, w->pool, &w->conf);
+		printf("[+] Thread %d (cpu %d): calibrated threshold = %d\n", w->id, w->cpu, w->conf.threshold);
+	}
+	// Lines of the sets found stay taken, so later searches cannot reuse them
+	if (w->conf.threshold > 0) {
+		ctx = ctx_create(w->pool, w->pool_sz, w->conf, w->seed);
+	}
+
+	while ((i = __atomic_fetch_add(w->next, 1, __ATOMIC_RELAXED)) < w->n) {
+		struct parallel_result_t *r = &w->results[i];
+		struct eviction_set_t es;
+
+		r->victim = w->victims[i];
+		r->cpu = w->cpu;
+		r->lines = NULL;
+		r->len = 0;
+		r->ret = !ctx || ctx_find(ctx, r->victim, &es) || !es.set;
+		if (!r->ret) {
+			save_result(r, es.set);
+		}
+	}
+	ctx_destroy(ctx);
+	return NULL;
+}
+
+/**
+ * Runs independent find_eviction_set searches on several pinned threads.
+ * Each thread owns a disjoint slice of the pool, its own RNG state and
+ * oracle, and takes victims from a shared queue; results are written to
+ * the victim's own slot, so no locking is needed. Threads search through a
+ * context (ctx.h), so the sets they return never share lines.
+ *
+ * @param cpus CPUs to pin threads to, NULL for one per physical core
+ * @param oracles one oracle per thread, NULL for the hardware path
+ * @return number of victims with an eviction set, -1 on setup errors.
+ */
+int
+find_eviction_sets_parallel(char *pool, unsigned long pool_sz, char **victims, int n,
+			    struct eviction_config_t conf, int threads, const int *cpus, struct oracle_t *oracles,
+			    uint64_t seed, struct parallel_result_t *results)
+{
+	int physical[MAX_CPUS], t, i, next = 0, found = 0;
+	struct worker_t *workers;
+	unsigned long slice = threads > 0 ? pool_sz / threads : 0;
+
+	// Keep slices page aligned for the stride pattern
+	slice -= slice % (conf.stride > 4096 ? conf.stride : 4096);
+	if (threads <= 0 || slice / conf.stride < (unsigned long)conf.initial_set_size) {
+		printf("[!] Error: pool too small for %d threads\n", threads);
+		return -1;
+	}
+
+	if (!cpus) {
+		int ncpus = parallel_physical_cpus(physical, MAX_CPUS);
+		if (ncpus < threads) {
+			printf("[!] Warning: %d physical cores for %d threads\n", ncpus, threads);
+		}
+		for (t = ncpus; t < threads; t++) {
+			physical[t] = -1; // unpinned
+		}
+		cpus = physical;
+	}
+
+	workers = (struct worker_t *)calloc(threads, sizeof(struct worker_t));
+	if (!workers) {
+		return -1;
+	}
+
+	for (t = 0; t < threads; t++) {
+		struct worker_t *w = &workers[t];
+		w->id = t;
+		w->cpu = cpus[t];
+		w->pool = pool + t * slice;
+		w->pool_sz = slice;
+		w->conf = conf;
+		w->conf.oracle = oracles ? &oracles[t] : NULL;
+		w->conf.trace = NULL; // a trace is not shared between threads
+		w->seed = seed + t;
+		w->victims = victims;
+		w->n = n;
+		w->next = &next;
+		w->results = results;
+		if (pthread_create(&w->thread, NULL, worker, w)) {
+			printf("[!] Error: could not start thread %d\n", t);
+			threads = t;
+			break;
+		}
+	}
+
+	for (t = 0; t < threads; t++) {
+		pthread_join(workers[t].thread, NULL);
+	}
+	free(workers);
+
+	if (threads == 0) {
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		found += !results[i].ret;
+	}
+	return found;
+}
@@ -0,0 +1,23 @@
+#ifndef parallel_H
+#define parallel_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+#include "oracle.h"
+
+struct parallel_result_t {
+	char *victim;
+	int ret; // find_eviction_set result
+	int cpu; // core that measured it
+	int len;
+	cache_block_t **lines; // lines of the eviction set, in order; free() when done
+};
+
+int parallel_physical_cpus(int *cpus, int max);
+int find_eviction_sets_parallel(char *pool, unsigned long pool_sz, char **victims, int n,
+				struct eviction_config_t conf, int threads, const int *cpus, struct oracle_t *oracles,
+				uint64_t seed, struct parallel_result_t *results);
+
+#endif /* parallel_H */
@@ -0,0 +1,174 @@
+#include "physical.h"
+#include "list_utils.h"
+#include "oracle.h"
+#include "pagemap.h"
+#include "reduction.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Below this share of translated lines, buckets say little: use timing
+#define PHYS_MIN_TRANSLATED 0.9
+
+static double
+elapsed(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static cache_block_t *
+link_lines(cache_block_t **lines, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		lines[i]->prev = i ? lines[i - 1] : NULL;
+		lines[i]->next = i + 1 < n ? lines[i + 1] : NULL;
+		lines[i]->set = -1;
+	}
+	return n ? lines[0] : NULL;
+}
+
+/*
+ * One bucket: its first line is the victim, the next cache_way lines the
+ * candidate set. If the test disagrees, the whole bucket is reduced.
+ *
+ * @return 0 if confirmed, 1 if reduced by timing, -1 if no eviction set.
+ */
+static int
+from_bucket(cache_block_t **lines, int n, struct eviction_config_t *conf, struct eviction_set_t *out)
+{
+	cache_block_t *set, *can = NULL, *x;
+	char *victim = (char *)lines[0];
+
+	lines[0]->set = -1;
+	set = link_lines(lines + 1, conf->cache_way);
+	if (oracle_test(conf, set, victim)) {
+		out->victim = victim;
+		out->set = set;
+		out->len = conf->cache_way;
+		return 0;
+	}
+
+	set = link_lines(lines + 1, n - 1);
+	if (oracle_test(conf, set, victim) && !reduce_eviction_set(&set, &can, victim, conf)) {
+		for (x = can; x; x = x->next) {
+			x->set = -2;
+		}
+		out->victim = victim;
+		out->set = set;
+		out->len = list_length(set);
+		return 1;
+	}
+	list_concat(&set, can);
+	for (x = set; x; x = x->next) {
+		x->set = -2;
+	}
+	lines[0]->set = -2;
+	return -1;
+}
+
+/**
+ * Finds up to max_sets eviction sets at the page offset of the pool lines
+ * (conf.stride apart), one per (set, slice) bucket with enough lines.
+ *
+ * @return number of eviction sets found, or -1 if too few lines could be
+ * translated and the caller should fall back to find_all_eviction_sets.
+ */
+int
+find_all_eviction_sets_physical(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+				const struct slice_fn_t *f, translate_fn translate, void *priv,
+				struct eviction_set_t *sets, int max_sets)
+{
+	unsigned long i, n = pool_sz / conf.stride;
+	int b, nbuckets = f->sets * f->slices, found = 0, confirmed = 0, reduced = 0, failed = 0, ok;
+	cache_block_t **lines = (cache_block_t **)malloc(n * sizeof(*lines));
+	cache_block_t **sorted = (cache_block_t **)malloc(n * sizeof(*sorted));
+	uint64_t *paddrs = (uint64_t *)malloc(n * sizeof(*paddrs));
+	uint32_t *set = (uint32_t *)malloc(n * sizeof(*set));
+	uint16_t *slice = (uint16_t *)malloc(n * sizeof(*slice));
+	int *start = (int *)calloc(nbuckets + 1, sizeof(int));
+	struct timespec t0;
+
+	if (!lines || !sorted || !paddrs || !set || !slice || !start) {
+		found = -1;
+		goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++) {
+		lines[i] = (cache_block_t *)&pool[i * conf.stride];
+		lines[i]->set = -2;
+		lines[i]->next = lines[i]->prev = NULL;
+	}
+	if (conf.threshold <= 0) {
+		conf.threshold = oracle_calibrate(conf.oracle, (char *)lines[0], &conf);
+		printf("[+] Calibrated Threshold = %d\n", conf.threshold);
+		if (conf.threshold < 0) {
+			printf("[!] Error: calibration\n");
+			found = 0;
+			goto out;
+		}
+	}
+
+	ok = translate(priv, (void *const *)lines, paddrs, n);
+	printf("[+] Translated %d/%lu lines in %f seconds\n", ok, n, elapsed(&t0));
+	if (ok < PHYS_MIN_TRANSLATED * n) {
+		found = -1;
+		goto out;
+	}
+	classify_bulk(f, paddrs, n, set, slice);
+
+	// Counting sort by bucket, untranslated lines are left out
+	for (i = 0; i < n; i++) {
+		if (paddrs[i] != PADDR_INVALID) {
+			start[slice[i] * f->sets + set[i] + 1]++;
+		}
+	}
+	for (b = 0; b < nbuckets; b++) {
+		start[b + 1] += start[b];
+	}
+	for (i = 0; i < n; i++) {
+		if (paddrs[i] != PADDR_INVALID) {
+			sorted[start[slice[i] * f->sets + set[i]]++] = lines[i];
+		}
+	}
+	for (b = nbuckets; b > 0; b--) {
+		start[b] = start[b - 1];
+	}
+	start[0] = 0;
+
+	for (b = 0; b < nbuckets && found < max_sets; b++) {
+		int len = start[b + 1] - start[b];
+		if (len <= conf.cache_way) {
+			continue;
+		}
+		switch (from_bucket(&sorted[start[b]], len, &conf, &sets[found])) {
+		case 0:
+			confirmed++;
+			found++;
+			break;
+		case 1:
+			reduced++;
+			found++;
+			break;
+		default:
+			failed++;
+		}
+	}
+
+	double t = elapsed(&t0);
+	printf("[+] Found %d eviction sets in %f seconds (%.02f sets/s): %d confirmed by one test, %d reduced by "
+	       "timing, %d buckets failed\n",
+	       found, t, found / t, confirmed, reduced, failed);
+out:
+	free(lines);
+	free(sorted);
+	free(paddrs);
+	free(set);
+	free(slice);
+	free(start);
+	return found;
+}
@@ -0,0 +1,24 @@
+#ifndef physical_H
+#define physical_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+#include "classify.h"
+
+/*
+ * Fast path for hosts that can translate addresses (root, or the
+ * simulator): pool lines are bucketed by their computed (set, slice), and
+ * every bucket with more than cache_way lines directly yields a candidate
+ * eviction set, confirmed with a single test. Candidates that fail the test
+ * are reduced by timing from the whole bucket, which also cross-checks the
+ * slice function.
+ */
+typedef int (*translate_fn)(void *priv, void *const *addrs, uint64_t *paddrs, int n);
+
+int find_all_eviction_sets_physical(char *pool, unsigned long pool_sz, struct eviction_config_t conf,
+				    const struct slice_fn_t *f, translate_fn translate, void *priv,
+				    struct eviction_set_t *sets, int max_sets);
+
+#endif /* physical_H */
@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include "pool.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define HUGETLBFS_MAGIC 0x958458f6
+
+#define SIZE_4K (1UL << 12)
+#define SIZE_2M (1UL << 21)
+#define SIZE_1G (1UL << 30)
+
+static const char *kinds[] = { "1GB", "2MB", "THP", "4KB" };
+
+static unsigned long
+round_up(unsigned long n, unsigned long align)
+{
+	return (n + align - 1) & ~(align - 1);
+}
+
+/**
+ * Pool size for conf: room for several initial sets at the stride, and at
+ * least 16 times the cache, so that every color of the stride is reachable
+ * with plenty of lines left for retries.
+ *
+ * @return size in bytes, a multiple of 2MB.
+ */
+unsigned long
+pool_size(const struct eviction_config_t *conf)
+{
+	unsigned long lines = 4UL * conf->initial_set_size * conf->stride;
+	unsigned long cache = 16UL * conf->cache_size;
+
+	return round_up(lines > cache ? lines : cache, SIZE_2M);
+}
+
+const char *
+pool_kind_name(enum pool_kind kind)
+{
+	return kinds[kind];
+}
+
+static char *
+map(unsigned long size, int flags)
+{
+	char *p = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+// 2MB aligned anonymous mapping, with transparent hugepages if asked for
+static char *
+map_aligned(unsigned long size, int thp)
+{
+	char *p = map(size + SIZE_2M, 0), *q;
+
+	if (!p) {
+		return NULL;
+	}
+	q = (char *)round_up((unsigned long)p, SIZE_2M);
+	if (q > p) {
+		munmap(p, q - p);
+	}
+	munmap(q + size, p + SIZE_2M - q);
+	if (thp && madvise(q, size, MADV_HUGEPAGE)) {
+		munmap(q, size);
+		return NULL;
+	}
+	return q;
+}
+
+static int
+open_file(struct pool_t *p, unsigned long size, const char *path, int flags)
+{
+	struct statfs fs;
+	struct stat st;
+
+	p->fd = open(path, O_CREAT | O_RDWR, 0600);
+	if (p->fd < 0) {
+		perror("open pool");
+		return -1;
+	}
+	if (fstatfs(p->fd, &fs) || fs.f_type != HUGETLBFS_MAGIC) {
+		printf("[!] Error: %s is not on hugetlbfs\n", path);
+		goto fail;
+	}
+	p->kind = (unsigned long)fs.f_bsize >= SIZE_1G ? POOL_1G : POOL_2M;
+	p->size = round_up(size, fs.f_bsize);
+
+	// An existing file is mapped as it is, unless it is too small
+	if (fstat(p->fd, &st)) {
+		goto fail;
+	}
+	if ((unsigned long)st.st_size < p->size) {
+		if (ftruncate(p->fd, p->size)) {
+			perror("ftruncate pool");
+			goto fail;
+		}
+		p->created = 1;
+	} else {
+		p->size = st.st_size;
+	}
+
+	p->base = (char *)mmap(NULL, p->size, PROT_READ | PROT_WRITE,
+			       MAP_SHARED | (flags & POOL_POPULATE ? MAP_POPULATE : 0), p->fd, 0);
+	if (p->base == MAP_FAILED) {
+		perror("mmap pool");
+		p->base = NULL;
+		goto fail;
+	}
+	return 0;
+fail:
+	close(p->fd);
+	p->fd = -1;
+	return -1;
+}
+
+/**
+ * Maps a pool of at least size bytes, from the file at path (on hugetlbfs)
+ * if path is not NULL. Anonymous pools fall back from 1GB pages to 4KB
+ * pages; POOL_NOHUGE starts at 4KB pages.
+ *
+ * @return 0 on success, -1 if no memory could be mapped.
+ */
+int
+pool_open(struct pool_t *p, unsigned long size, const char *path, int flags)
+{
+	int populate = flags & POOL_POPULATE ? MAP_POPULATE : 0;
+	unsigned long i;
+
+	memset(p, 0, sizeof(*p));
+	p->fd = -1;
+
+	if (path) {
+		if (open_file(p, size, path, flags)) {
+			return -1;
+		}
+	} else if (!(flags & POOL_NOHUGE) &&
+		   (p->base = map(round_up(size, SIZE_1G), MAP_HUGETLB | MAP_HUGE_1GB | populate))) {
+		p->kind = POOL_1G;
+		p->size = round_up(size, SIZE_1G);
+	} else if (!(flags & POOL_NOHUGE) &&
+		   (p->base = map(round_up(size, SIZE_2M), MAP_HUGETLB | MAP_HUGE_2MB | populate))) {
+		p->kind = POOL_2M;
+		p->size = round_up(size, SIZE_2M);
+	} else {
+		// Pages must not be faulted in before madvise, they are touched below
+		p->size = round_up(size, SIZE_2M);
+		p->kind = POOL_THP;
+		if ((flags & POOL_NOHUGE) || !(p->base = map_aligned(p->size, 1))) {
+			p->kind = POOL_4K;
+			p->base = map_aligned(p->size, 0);
+		}
+		if (!p->base) {
+			return -1;
+		}
+		for (i = 0; populate && i < p->size; i += SIZE_4K) {
+			p->base[i] = 0;
+		}
+	}
+
+	if (flags & POOL_LOCK) {
+		p->locked = !mlock(p->base, p->size);
+	}
+	return 0;
+}
+
+void
+pool_close(struct pool_t *p)
+{
+	if (p->base) {
+		if (p->locked) {
+			munlock(p->base, p->size);
+		}
+		munmap(p->base, p->size);
+	}
+	if (p->fd >= 0) {
+		close(p->fd);
+	}
+	p->base = NULL;
+	p->fd = -1;
+}
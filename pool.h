@@ -0,0 +1,44 @@
+#ifndef pool_H
+#define pool_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+
+/*
+ * Memory for the candidate pool. An anonymous pool is mapped with the
+ * largest pages available: 1GB hugetlb pages, then 2MB hugetlb pages, then
+ * transparent hugepages requested with madvise, then 4KB pages. A pool
+ * backed by a file on hugetlbfs is shared: its pages, and so the physical
+ * addresses of its lines, outlive the process, so eviction sets stored as
+ * offsets into the pool stay valid when the file is mapped again.
+ */
+enum pool_kind {
+	POOL_1G,
+	POOL_2M,
+	POOL_THP, // 2MB aligned, huge pages requested but not guaranteed
+	POOL_4K,
+};
+
+#define POOL_NOHUGE 1 // 4KB pages only
+#define POOL_POPULATE 2 // fault every page in before use
+#define POOL_LOCK 4 // mlock, so pages are neither swapped nor migrated
+
+struct pool_t {
+	char *base;
+	unsigned long size;
+	enum pool_kind kind;
+	int fd; // hugetlbfs file, -1 for an anonymous pool
+	int locked;
+	int created; // the file was created (or grown), its contents are new
+};
+
+unsigned long pool_size(const struct eviction_config_t *conf);
+
+int pool_open(struct pool_t *p, unsigned long size, const char *path, int flags);
+void pool_close(struct pool_t *p);
+
+const char *pool_kind_name(enum pool_kind kind);
+
+#endif /* pool_H */
@@ -0,0 +1,255 @@
+#include "reduction.h"
+#include "cset.h"
+#include "list_utils.h"
+#include "oracle.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const struct reduction_t reductions[] = {
+	{ 'n', "naive", naive_eviction },
+	{ 'o', "naive optimistic", naive_eviction_optimistic },
+	{ 'g', "group testing", gt_reduce },
+	{ 'b', "binary group testing", binary_eviction },
+};
+
+const struct reduction_t *
+reduction_find(char name)
+{
+	unsigned int i;
+	for (i = 0; i < sizeof(reductions) / sizeof(reductions[0]); i++) {
+		if (reductions[i].name == name) {
+			return &reductions[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Reduces set to a minimal eviction set for victim with the configured
+ * algorithm, and reports the tests and lines it took.
+ *
+ * @return 0 on success, 1 if no minimal eviction set was found.
+ */
+int
+reduce_eviction_set(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	const struct reduction_t *r = reduction_find(conf->algorithm ? conf->algorithm : 'g');
+	struct eviction_stats_t stats = { 0 }, *outer = conf->stats;
+	struct trace_mark_t m;
+	int ret;
+
+	if (!r) {
+		printf("[!] Error: unknown algorithm '%c'\n", conf->algorithm);
+		return 1;
+	}
+
+	conf->stats = &stats;
+	trace_mark(conf->trace, &m);
+	ret = r->reduce(set, can, victim, conf);
+	trace_record(conf->trace, &m, TRACE_REDUCE, -1, list_length(*set), -1);
+	conf->stats = outer;
+
+	// Levels were only buffered while the reduction ran
+	trace_flush(conf->trace);
+
+	printf("[+] Reduction (%s): %lu tests, %lu lines traversed, %lu backtracks, %lu cached\n", r->desc,
+	       stats.tests, stats.lines, stats.backtracks, stats.cached);
+	if (outer) {
+		outer->tests += stats.tests;
+		outer->probes += stats.probes;
+		outer->lines += stats.lines;
+		outer->backtracks += stats.backtracks;
+		outer->cached += stats.cached;
+	}
+	return ret;
+}
+
+int
+gt_reduce(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	if (conf->engine == ENGINE_ARRAY) {
+		return gt_eviction_array(set, can, victim, conf);
+	}
+	return gt_eviction(set, can, victim, conf);
+}
+
+static int
+load(struct cset_t *c, cache_block_t *set)
+{
+	if (cset_init(c, list_length(set)) || cset_from_list(c, set)) {
+		cset_free(c);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+store(struct cset_t *c, cache_block_t **set, cache_block_t **can, int ret)
+{
+	*set = cset_link(c, 0, c->len, -1, -1);
+	list_concat(can, cset_link(c, c->len, c->size, -1, -1));
+	cset_free(c);
+	return ret;
+}
+
+static void
+swap(struct cset_t *c, int i, int j)
+{
+	cache_block_t *tmp = c->lines[i];
+	c->lines[i] = c->lines[j];
+	c->lines[j] = tmp;
+}
+
+/**
+ * Binary group testing: finds the congruent lines one at a time. With the f
+ * lines found so far at the front, a binary search over prefixes finds the
+ * shortest prefix that evicts the victim; its last line is congruent and
+ * moves to position f, and everything after the prefix is discarded. Each
+ * line costs log2(n) tests, a * log2(n) in total.
+ */
+int
+binary_eviction(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	struct cset_t c;
+	struct trace_mark_t m;
+	int f = 0, lo, hi, mid, n;
+
+	if (load(&c, *set)) {
+		return 1;
+	}
+	n = c.len;
+
+	while (f < conf->cache_way) {
+		trace_mark(conf->trace, &m);
+		// Invariant: [0, lo) does not evict, [0, hi) does
+		lo = f;
+		hi = c.len;
+		if (!oracle_test_len(conf, cset_link(&c, 0, hi, -1, -1), hi, victim)) {
+			return store(&c, set, can, 1);
+		}
+		while (hi - lo > 1) {
+			mid = lo + (hi - lo) / 2;
+			if (oracle_test_len(conf, cset_link(&c, 0, mid, -1, -1), mid, victim)) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+		swap(&c, f, hi - 1);
+		f++;
+		c.len = hi;
+		trace_record(conf->trace, &m, TRACE_LEVEL, f, c.len, n - c.len);
+	}
+
+	c.len = f;
+	return store(&c, set, can, !oracle_test_len(conf, cset_link(&c, 0, f, -1, -1), f, victim));
+}
+
+/*
+ * Naive reduction: drop each line whose removal keeps the set evicting.
+ * One test of the whole set per line, O(n^2) lines traversed. The
+ * optimistic variant stops as soon as the set is down to the associativity.
+ */
+static int
+naive(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf, int optimistic)
+{
+	struct cset_t c;
+	int i;
+
+	if (load(&c, *set)) {
+		return 1;
+	}
+
+	// Removing swaps in the last line, which was already tested
+	for (i = c.len - 1; i >= 0 && (!optimistic || c.len > conf->cache_way); i--) {
+		if (oracle_test_len(conf, cset_link(&c, 0, c.len, i, i + 1), c.len - 1, victim)) {
+			cset_remove(&c, i, i + 1);
+		}
+	}
+
+	return store(&c, set, can,
+		     c.len > conf->cache_way || !oracle_test_len(conf, cset_link(&c, 0, c.len, -1, -1), c.len, victim));
+}
+
+int
+naive_eviction(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	return naive(set, can, victim, conf, 0);
+}
+
+int
+naive_eviction_optimistic(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	return naive(set, can, victim, conf, 1);
+}
+
+/**
+ * Repairs a near-minimal or stale eviction set from spare candidates (the
+ * lines a reduction discarded, or fresh ones) instead of starting over.
+ * While set does not evict the victim, a binary search over prefixes of can
+ * appended to set finds the shortest one that does; its last line is
+ * congruent and joins set. Then, while set is larger than the associativity,
+ * each original line whose removal keeps set evicting is dropped: these are
+ * the lines that lost congruence. One or two bad lines cost a few
+ * log2(|can|) searches plus one test per line of set. Sets of more than
+ * twice the associativity are not near-minimal, pruning them would cost more
+ * than a new search, and are left untouched.
+ *
+ * @return 0 if set is now a minimal eviction set, 1 otherwise. Lines not in
+ * set are left in can either way.
+ */
+int
+repair_eviction_set(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf)
+{
+	struct cset_t c;
+	int s, s0, lo, hi, mid, added = 0, pruned = 0, ret, i;
+	cache_block_t *all = *set;
+
+	s = list_length(*set);
+	if (s > 2 * conf->cache_way) {
+		return 1;
+	}
+	list_concat(&all, *can);
+	*can = NULL;
+	if (load(&c, all)) {
+		*set = all;
+		return 1;
+	}
+
+	while (!oracle_test_len(conf, cset_link(&c, 0, s, -1, -1), s, victim) && added < conf->cache_way) {
+		// Invariant: [0, lo) does not evict, [0, hi) does
+		lo = s;
+		hi = c.len;
+		if (hi == lo || !oracle_test_len(conf, cset_link(&c, 0, hi, -1, -1), hi, victim)) {
+			break;
+		}
+		while (hi - lo > 1) {
+			mid = lo + (hi - lo) / 2;
+			if (oracle_test_len(conf, cset_link(&c, 0, mid, -1, -1), mid, victim)) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+		swap(&c, s, hi - 1);
+		s++;
+		added++;
+	}
+
+	// Added lines sit at [s0, s) and are congruent, only test the others
+	s0 = s - added;
+	for (i = s0 - 1; i >= 0 && s > conf->cache_way; i--) {
+		if (oracle_test_len(conf, cset_link(&c, 0, s, i, i + 1), s - 1, victim)) {
+			swap(&c, i, s - 1);
+			s--;
+			pruned++;
+		}
+	}
+
+	ret = s > conf->cache_way || !oracle_test_len(conf, cset_link(&c, 0, s, -1, -1), s, victim);
+	printf("[+] Repair: %d lines added, %d pruned, %d left (%s)\n", added, pruned, s, ret ? "failed" : "ok");
+	c.len = s;
+	return store(&c, set, can, ret);
+}
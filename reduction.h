@@ -0,0 +1,33 @@
+#ifndef reduction_H
+#define reduction_H
+
+#include <stdlib.h>
+
+#include "eviction.h"
+
+/*
+ * Reduction strategies: turn a list that evicts the victim into a minimal
+ * eviction set. All share one signature; the reduced set is left in *set and
+ * every discarded line is appended to *can.
+ */
+typedef int (*reduce_fn)(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+
+struct reduction_t {
+	char name; // -a flag
+	const char *desc;
+	reduce_fn reduce;
+};
+
+const struct reduction_t *reduction_find(char name);
+
+int reduce_eviction_set(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+
+int gt_reduce(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+int binary_eviction(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+int naive_eviction(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+int naive_eviction_optimistic(cache_block_t **set, cache_block_t **can, char *victim,
+			      struct eviction_config_t *conf);
+
+int repair_eviction_set(cache_block_t **set, cache_block_t **can, char *victim, struct eviction_config_t *conf);
+
+#endif /* reduction_H */
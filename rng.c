@@ -0,0 +1,80 @@
+#include "rng.h"
+
+#include <stdlib.h>
+
+static __thread struct rng_t rng = { { 0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 1 } };
+
+static uint64_t
+rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+void
+rng_init(struct rng_t *r, uint64_t seed)
+{
+	int i;
+
+	// splitmix64, never yields the all-zero state
+	for (i = 0; i < 4; i++) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		r->s[i] = z ^ (z >> 31);
+	}
+}
+
+uint64_t
+rng_next(struct rng_t *r)
+{
+	uint64_t *s = r->s;
+	uint64_t ret = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return ret;
+}
+
+/**
+ * Uniform in [0, n), without modulo bias: draws below 2^64 mod n are
+ * rejected.
+ */
+uint64_t
+rng_below(struct rng_t *r, uint64_t n)
+{
+	uint64_t x, min = -n % n;
+
+	do {
+		x = rng_next(r);
+	} while (x < min);
+	return x % n;
+}
+
+struct rng_t *
+rng_thread(void)
+{
+	return &rng;
+}
+
+void
+rng_seed(uint64_t seed)
+{
+	rng_init(&rng, seed);
+}
+
+int
+rng_rand(void)
+{
+	return rng_next(&rng) >> 33;
+}
+
+uint64_t
+rng_range(uint64_t n)
+{
+	return rng_below(&rng, n);
+}
@@ -0,0 +1,30 @@
+#ifndef rng_H
+#define rng_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Per-thread replacement for rand()/srand(): each thread draws from its own
+ * state, so parallel searches neither contend on nor perturb each other.
+ * The generator is xoshiro256**, seeded through splitmix64 so that nearby
+ * seeds (seed + thread id) give unrelated streams.
+ */
+#define RNG_MAX 0x7fffffff
+
+struct rng_t {
+	uint64_t s[4];
+};
+
+void rng_init(struct rng_t *r, uint64_t seed);
+uint64_t rng_next(struct rng_t *r);
+uint64_t rng_below(struct rng_t *r, uint64_t n);
+
+// Thread's own generator, behind rng_seed/rng_rand/rng_range
+struct rng_t *rng_thread(void);
+
+void rng_seed(uint64_t seed);
+int rng_rand(void);
+uint64_t rng_range(uint64_t n);
+
+#endif /* rng_H */
@@ -0,0 +1,349 @@
+#include "sim.h"
+#include "traversal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_LINE_BITS 6
+#define SIM_PHYS_BITS 40
+
+static uint64_t
+mix64(uint64_t x)
+{
+	// splitmix64 finalizer
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static double
+sim_uniform(struct sim_t *sim)
+{
+	sim->rng ^= sim->rng << 13;
+	sim->rng ^= sim->rng >> 7;
+	sim->rng ^= sim->rng << 17;
+	return (sim->rng >> 11) * (1.0 / (1ULL << 53));
+}
+
+static int
+ilog2(unsigned long n)
+{
+	int r = 0;
+	while ((1UL << r) < n) {
+		r++;
+	}
+	return r;
+}
+
+void
+sim_default_config(struct sim_config_t *conf, struct eviction_config_t *ev)
+{
+	// according to Maurice et al.
+	static const uint64_t masks[] = { 0x1b5f575440ULL, 0x2eb5faa880ULL, 0x3cccc93100ULL };
+	int i;
+
+	memset(conf, 0, sizeof(*conf));
+	conf->ways = ev->cache_way;
+	conf->slices = ev->cache_slices;
+	conf->sets = ev->cache_size / ((1 << SIM_LINE_BITS) * ev->cache_way * ev->cache_slices);
+	conf->page_bits = 12;
+	conf->nmasks = ilog2(ev->cache_slices);
+	for (i = 0; i < conf->nmasks && i < 3; i++) {
+		conf->masks[i] = masks[i];
+	}
+	conf->policy = SIM_LRU;
+	conf->hit_cycles = 40;
+	conf->miss_cycles = 200;
+	conf->noise = 0;
+	conf->seed = 1;
+}
+
+int
+sim_init(struct sim_t *sim, const struct sim_config_t *conf)
+{
+	size_t lines;
+
+	memset(sim, 0, sizeof(*sim));
+	if (conf->sets <= 0 || (conf->sets & (conf->sets - 1)) || conf->ways <= 0 || conf->ways > 64 ||
+	    conf->slices <= 0 || conf->nmasks > SIM_MAX_MASKS || conf->page_bits < SIM_LINE_BITS ||
+	    conf->page_bits >= SIM_PHYS_BITS) {
+		return -1;
+	}
+	if (conf->policy == SIM_PLRU && (conf->ways & (conf->ways - 1))) {
+		return -1;
+	}
+
+	sim->conf = *conf;
+	sim->set_bits = ilog2(conf->sets);
+
+	lines = (size_t)conf->sets * conf->slices * conf->ways;
+	sim->tags = (uint64_t *)calloc(lines, sizeof(uint64_t));
+	sim->state = (uint64_t *)calloc(lines, sizeof(uint64_t));
+	if (!sim->tags || !sim->state) {
+		sim_free(sim);
+		return -1;
+	}
+	sim->rng = mix64(conf->seed) | 1;
+	return 0;
+}
+
+void
+sim_free(struct sim_t *sim)
+{
+	free(sim->tags);
+	free(sim->state);
+	sim->tags = NULL;
+	sim->state = NULL;
+}
+
+void
+sim_flush_all(struct sim_t *sim)
+{
+	size_t lines = (size_t)sim->conf.sets * sim->conf.slices * sim->conf.ways;
+	memset(sim->tags, 0, lines * sizeof(uint64_t));
+	memset(sim->state, 0, lines * sizeof(uint64_t));
+}
+
+uint64_t
+sim_paddr(struct sim_t *sim, const void *addr)
+{
+	uint64_t vaddr = (uint64_t)addr;
+	int bits = sim->conf.page_bits;
+	uint64_t frame = mix64((vaddr >> bits) ^ sim->conf.seed) & ((1ULL << (SIM_PHYS_BITS - bits)) - 1);
+	return (frame << bits) | (vaddr & ((1ULL << bits) - 1));
+}
+
+int
+sim_slice(struct sim_t *sim, uint64_t paddr)
+{
+	int i, ret = 0;
+	for (i = sim->conf.nmasks - 1; i >= 0; i--) {
+		ret = (ret << 1) | __builtin_parityll(sim->conf.masks[i] & paddr);
+	}
+	return ret % sim->conf.slices;
+}
+
+int
+sim_set(struct sim_t *sim, uint64_t paddr)
+{
+	return (paddr >> SIM_LINE_BITS) & (sim->conf.sets - 1);
+}
+
+static void
+plru_touch(uint64_t *tree, int ways, int way)
+{
+	int levels = ilog2(ways), node = 1, l;
+	for (l = levels - 1; l >= 0; l--) {
+		int dir = (way >> l) & 1;
+		// point away from the accessed way
+		if (dir) {
+			*tree &= ~(1ULL << node);
+		} else {
+			*tree |= 1ULL << node;
+		}
+		node = 2 * node + dir;
+	}
+}
+
+static int
+plru_victim(uint64_t tree, int ways)
+{
+	int levels = ilog2(ways), node = 1, way = 0, l;
+	for (l = 0; l < levels; l++) {
+		int dir = (tree >> node) & 1;
+		way = (way << 1) | dir;
+		node = 2 * node + dir;
+	}
+	return way;
+}
+
+static void
+sim_touch(struct sim_t *sim, size_t base, int way, int hit)
+{
+	switch (sim->conf.policy) {
+	case SIM_LRU:
+		sim->state[base + way] = ++sim->clock;
+		break;
+	case SIM_PLRU:
+		plru_touch(&sim->state[base], sim->conf.ways, way);
+		break;
+	case SIM_QLRU:
+		sim->state[base + way] = hit ? 0 : 1;
+		break;
+	}
+}
+
+static int
+sim_victim(struct sim_t *sim, size_t base)
+{
+	int w, ways = sim->conf.ways, ret = 0;
+
+	for (w = 0; w < ways; w++) {
+		if (!sim->tags[base + w]) {
+			return w;
+		}
+	}
+
+	switch (sim->conf.policy) {
+	case SIM_LRU:
+		for (w = 1; w < ways; w++) {
+			if (sim->state[base + w] < sim->state[base + ret]) {
+				ret = w;
+			}
+		}
+		break;
+	case SIM_PLRU:
+		ret = plru_victim(sim->state[base], ways);
+		break;
+	case SIM_QLRU:
+		for (;;) {
+			uint64_t max = 0;
+			for (w = 0; w < ways; w++) {
+				if (sim->state[base + w] == 3) {
+					return w;
+				}
+				if (sim->state[base + w] > max) {
+					max = sim->state[base + w];
+				}
+			}
+			for (w = 0; w < ways; w++) {
+				sim->state[base + w] += 3 - max;
+			}
+		}
+	}
+	return ret;
+}
+
+/**
+ * Access one address in the simulated cache.
+ *
+ * @return 1 on hit, 0 on miss (the line is then filled).
+ */
+int
+sim_access(struct sim_t *sim, const void *addr)
+{
+	uint64_t paddr = sim_paddr(sim, addr);
+	uint64_t tag = (paddr >> SIM_LINE_BITS) + 1;
+	size_t base = ((size_t)sim_slice(sim, paddr) * sim->conf.sets + sim_set(sim, paddr)) * sim->conf.ways;
+	int w;
+
+	for (w = 0; w < sim->conf.ways; w++) {
+		if (sim->tags[base + w] == tag) {
+			sim_touch(sim, base, w, 1);
+			return 1;
+		}
+	}
+
+	w = sim_victim(sim, base);
+	sim->tags[base + w] = tag;
+	sim_touch(sim, base, w, 0);
+	return 0;
+}
+
+int
+sim_parse_policy(const char *name, enum sim_policy *policy)
+{
+	if (!strcmp(name, "lru")) {
+		*policy = SIM_LRU;
+	} else if (!strcmp(name, "plru")) {
+		*policy = SIM_PLRU;
+	} else if (!strcmp(name, "qlru")) {
+		*policy = SIM_QLRU;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+sim_latency(struct sim_t *sim, int hit)
+{
+	if (sim->conf.noise > 0 && sim_uniform(sim) < sim->conf.noise) {
+		hit = !hit;
+	}
+	return hit ? sim->conf.hit_cycles : sim->conf.miss_cycles;
+}
+
+static void
+sim_access_line(void *ctx, void *p)
+{
+	sim_access((struct sim_t *)ctx, p);
+}
+
+static void
+sim_traverse(struct sim_t *sim, cache_block_t *set, const struct traversal_t *t)
+{
+	if (t) {
+		traverse_pattern(set, t, sim_access_line, sim);
+		return;
+	}
+	while (set) {
+		sim_access(sim, set);
+		set = set->next;
+	}
+}
+
+// Same access sequence as test_set
+static int
+sim_probe(void *priv, cache_block_t *set, char *victim, const struct traversal_t *t)
+{
+	struct sim_t *sim = (struct sim_t *)priv;
+
+	sim_access(sim, victim);
+	sim_access(sim, victim);
+	sim_access(sim, victim);
+	sim_access(sim, victim);
+
+	sim_traverse(sim, set, t);
+
+	sim_access(sim, victim + 222); // page walk
+
+	return sim_latency(sim, sim_access(sim, victim));
+}
+
+// Same access sequence as test_set_batch
+static void
+sim_probe_batch(void *priv, cache_block_t *set, char **victims, int n, int *lat, const struct traversal_t *t)
+{
+	struct sim_t *sim = (struct sim_t *)priv;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		sim_access(sim, victims[i]);
+		sim_access(sim, victims[i]);
+	}
+
+	sim_traverse(sim, set, t);
+
+	for (i = 0; i < n; i++) {
+		sim_access(sim, victims[i] + 222); // page walk
+	}
+
+	for (i = 0; i < n; i++) {
+		lat[i] = sim_latency(sim, sim_access(sim, victims[i]));
+	}
+}
+
+static int
+sim_calibrate(void *priv, char *victim, struct eviction_config_t *conf)
+{
+	struct sim_t *sim = (struct sim_t *)priv;
+	(void)victim;
+	(void)conf;
+
+	return (sim->conf.miss_cycles + sim->conf.hit_cycles * 2) / 3;
+}
+
+void
+sim_oracle_init(struct oracle_t *o, struct sim_t *sim)
+{
+	o->name = "sim";
+	o->probe = sim_probe;
+	o->probe_batch = sim_probe_batch;
+	o->calibrate = sim_calibrate;
+	o->priv = sim;
+	oracle_reset_stats(o);
+}
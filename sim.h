@@ -0,0 +1,63 @@
+#ifndef sim_H
+#define sim_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+#include "oracle.h"
+
+#define SIM_MAX_MASKS 8
+
+enum sim_policy {
+	SIM_LRU,
+	SIM_PLRU, // tree pseudo-LRU, ways must be a power of two
+	SIM_QLRU, // 2-bit ages: hit -> 0, insert at 1, evict first age 3
+};
+
+/*
+ * Deterministic sliced, set-associative LLC.
+ *
+ * Virtual addresses are mapped to simulated physical ones page by page: the
+ * low page_bits are kept and the frame number is a seeded hash of the virtual
+ * page number. The slice is the parity of each mask over the physical address,
+ * as in classify.h. When slices is not a power of two, the lookup table folds
+ * the hash value modulo slices.
+ */
+struct sim_config_t {
+	int sets; // per slice, power of two
+	int ways;
+	int slices;
+	int page_bits;
+	uint64_t masks[SIM_MAX_MASKS];
+	int nmasks;
+	enum sim_policy policy;
+	int hit_cycles, miss_cycles;
+	double noise; // probability of reporting the opposite latency
+	uint64_t seed;
+};
+
+struct sim_t {
+	struct sim_config_t conf;
+	uint64_t *tags; // line address + 1, 0 is invalid
+	uint64_t *state; // LRU stamp, QLRU age, or PLRU tree bits (one per set)
+	uint64_t clock;
+	uint64_t rng;
+	int set_bits;
+};
+
+void sim_default_config(struct sim_config_t *conf, struct eviction_config_t *ev);
+int sim_init(struct sim_t *sim, const struct sim_config_t *conf);
+void sim_free(struct sim_t *sim);
+void sim_flush_all(struct sim_t *sim);
+
+uint64_t sim_paddr(struct sim_t *sim, const void *addr);
+int sim_slice(struct sim_t *sim, uint64_t paddr);
+int sim_set(struct sim_t *sim, uint64_t paddr);
+int sim_access(struct sim_t *sim, const void *addr);
+
+int sim_parse_policy(const char *name, enum sim_policy *policy);
+
+void sim_oracle_init(struct oracle_t *o, struct sim_t *sim);
+
+#endif /* sim_H */
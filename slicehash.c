@@ -0,0 +1,136 @@
+#include "slicehash.h"
+#include "pagemap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void
+slicehash_init(struct slicehash_t *h, int lo)
+{
+	h->nrows = 0;
+	h->lo = lo;
+	h->seen = 0;
+}
+
+static int
+top_bit(uint64_t x)
+{
+	return 63 - __builtin_clzll(x);
+}
+
+// Adds d to the basis, keeping it fully reduced
+static int
+insert(struct slicehash_t *h, uint64_t d)
+{
+	int i, p;
+
+	for (i = 0; i < h->nrows; i++) {
+		if ((d >> h->pivot[i]) & 1) {
+			d ^= h->rows[i];
+		}
+	}
+	if (!d) {
+		return 0;
+	}
+	p = top_bit(d);
+	for (i = 0; i < h->nrows; i++) {
+		if ((h->rows[i] >> p) & 1) {
+			h->rows[i] ^= d;
+		}
+	}
+	h->rows[h->nrows] = d;
+	h->pivot[h->nrows] = p;
+	h->nrows++;
+	return 1;
+}
+
+/**
+ * Adds the physical addresses of one eviction set (victim included).
+ * Untranslated lines (PADDR_INVALID) are skipped.
+ *
+ * @return number of new independent differences.
+ */
+int
+slicehash_add_set(struct slicehash_t *h, const uint64_t *paddrs, int n)
+{
+	uint64_t keep = ~((1ULL << h->lo) - 1), base = PADDR_INVALID;
+	int i, ret = 0;
+
+	for (i = 0; i < n; i++) {
+		if (paddrs[i] == PADDR_INVALID) {
+			continue;
+		}
+		h->seen |= paddrs[i];
+		if (base == PADDR_INVALID) {
+			base = paddrs[i];
+		} else {
+			ret += insert(h, (paddrs[i] ^ base) & keep);
+		}
+	}
+	return ret;
+}
+
+/**
+ * Solves for the masks: one null space vector of the differences per bit
+ * between lo and the highest address bit seen that no difference pins down.
+ * More vectors than log2(slices) mean that more eviction sets are needed;
+ * fewer mean that the hash is not linear (e.g. non power of two slices).
+ *
+ * @return dimension of the null space, the first max vectors go to masks.
+ */
+int
+slicehash_solve(struct slicehash_t *h, uint64_t *masks, int max)
+{
+	int b, i, n = 0, hi = h->seen ? top_bit(h->seen) + 1 : 0;
+	uint64_t pivots = 0, m;
+
+	for (i = 0; i < h->nrows; i++) {
+		pivots |= 1ULL << h->pivot[i];
+	}
+	for (b = h->lo; b < hi; b++) {
+		if ((pivots >> b) & 1) {
+			continue;
+		}
+		// Free bit b, each pivot bit follows its row
+		m = 1ULL << b;
+		for (i = 0; i < h->nrows; i++) {
+			if ((h->rows[i] >> b) & 1) {
+				m |= 1ULL << h->pivot[i];
+			}
+		}
+		if (n < max) {
+			masks[n] = m;
+		}
+		n++;
+	}
+	return n;
+}
+
+/**
+ * @return rank over GF(2) of the masks.
+ */
+int
+slicehash_rank(const uint64_t *masks, int n)
+{
+	struct slicehash_t h;
+	int i, r = 0;
+
+	slicehash_init(&h, 0);
+	for (i = 0; i < n; i++) {
+		r += masks[i] ? insert(&h, masks[i]) : 0;
+	}
+	return r;
+}
+
+// Same layout as the mask table in classify.c
+void
+slicehash_print(const uint64_t *masks, int n)
+{
+	int i;
+
+	printf("unsigned long long mask[%d] = {", n);
+	for (i = 0; i < n; i++) {
+		printf("%s0x%llxULL", i ? ", " : "", (unsigned long long)masks[i]);
+	}
+	printf("};\n");
+}
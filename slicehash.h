@@ -0,0 +1,39 @@
+#ifndef slicehash_H
+#define slicehash_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define SLICEHASH_MAX_MASKS 8
+
+/*
+ * Recovery of a linear (XOR) slice hash from eviction sets.
+ *
+ * Lines of one eviction set share the slice, so every mask m of the hash
+ * satisfies parity(m & (a ^ b)) == 0 for any two of them: the masks span the
+ * null space, over GF(2), of the address differences. Differences are kept
+ * as an echelon basis, so adding a set costs a few XORs per line and solving
+ * is a single pass over at most 64 rows.
+ *
+ * Lines of an eviction set also share the set index, so bits below lo
+ * (line offset and set index) never differ and cannot be recovered: the
+ * masks come out with those bits cleared. This only relabels the slices
+ * within each set index, and two lines with the same set index are still
+ * congruent exactly when the recovered hash agrees.
+ */
+struct slicehash_t {
+	uint64_t rows[64]; // reduced row echelon basis of the differences
+	int pivot[64]; // leading bit of each row
+	int nrows;
+	int lo; // lowest bit that may differ between congruent lines
+	uint64_t seen; // OR of all address bits seen
+};
+
+void slicehash_init(struct slicehash_t *h, int lo);
+int slicehash_add_set(struct slicehash_t *h, const uint64_t *paddrs, int n);
+int slicehash_solve(struct slicehash_t *h, uint64_t *masks, int max);
+
+int slicehash_rank(const uint64_t *masks, int n);
+void slicehash_print(const uint64_t *masks, int n);
+
+#endif /* slicehash_H */
@@ -0,0 +1,424 @@
+#include "store.h"
+#include "list_utils.h"
+#include "oracle.h"
+#include "pagemap.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LINE_BITS 6
+
+// Victim followed by the lines of es, NULL on allocation failure or if the list is not es->len long
+static void **
+lines_of(const struct eviction_set_t *es)
+{
+	void **lines = (void **)malloc((es->len + 1) * sizeof(void *));
+	cache_block_t *x = es->set;
+	int i;
+
+	if (!lines) {
+		return NULL;
+	}
+	lines[0] = es->victim;
+	for (i = 1; i <= es->len && x; i++, x = x->next) {
+		lines[i] = x;
+	}
+	if (i <= es->len || x) {
+		printf("[!] Error: eviction set for %p has %s than %d lines\n", (void *)es->victim,
+		       x ? "more" : "fewer", es->len);
+		free(lines);
+		return NULL;
+	}
+	return lines;
+}
+
+static int
+offset_of(char *base, unsigned long size, void *p, uint32_t *off)
+{
+	unsigned long d = (char *)p - base;
+
+	if ((char *)p < base || d >= size || d % (1 << LINE_BITS) || (d >> LINE_BITS) > UINT32_MAX) {
+		return -1;
+	}
+	*off = d >> LINE_BITS;
+	return 0;
+}
+
+/**
+ * Writes sets to path. Every victim and line must lie in [base, base +
+ * size). With translate, the physical addresses are stored as well.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int
+store_save(const char *path, char *base, unsigned long size, const struct eviction_config_t *conf,
+	   const struct eviction_set_t *sets, int n, translate_fn translate, void *priv)
+{
+	struct store_header_t h;
+	uint32_t *offs = NULL;
+	uint64_t *paddrs = NULL;
+	void **lines, *p, *q;
+	int i, j, ret = -1;
+	FILE *f = fopen(path, "wb");
+
+	if (!f) {
+		perror("open store");
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, STORE_MAGIC, sizeof(h.magic));
+	h.version = STORE_VERSION;
+	h.flags = translate ? STORE_PADDRS : 0;
+	h.nsets = n;
+	h.threshold = conf->threshold;
+	h.cache_size = conf->cache_size;
+	h.cache_way = conf->cache_way;
+	h.cache_slices = conf->cache_slices;
+	h.stride = conf->stride;
+	h.size = size;
+	if (fwrite(&h, sizeof(h), 1, f) != 1) {
+		goto out;
+	}
+
+	for (i = 0; i < n; i++) {
+		uint32_t len = sets[i].len;
+
+		if (!(lines = lines_of(&sets[i]))) {
+			goto out;
+		}
+		if ((p = realloc(offs, (len + 1) * sizeof(uint32_t)))) {
+			offs = (uint32_t *)p;
+		}
+		if ((q = realloc(paddrs, (len + 1) * sizeof(uint64_t)))) {
+			paddrs = (uint64_t *)q;
+		}
+		if (!p || !q) {
+			free(lines);
+			goto out;
+		}
+		for (j = 0; j <= (int)len; j++) {
+			if (offset_of(base, size, lines[j], &offs[j])) {
+				printf("[!] Error: set %d has a line outside the pool\n", i);
+				free(lines);
+				goto out;
+			}
+		}
+		if (fwrite(&len, sizeof(len), 1, f) != 1 ||
+		    fwrite(offs, sizeof(uint32_t), len + 1, f) != len + 1) {
+			free(lines);
+			goto out;
+		}
+		if (translate) {
+			translate(priv, lines, paddrs, len + 1);
+			if (fwrite(paddrs, sizeof(uint64_t), len + 1, f) != len + 1) {
+				free(lines);
+				goto out;
+			}
+		}
+		free(lines);
+	}
+	ret = 0;
+out:
+	free(offs);
+	free(paddrs);
+	if (fclose(f)) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ * Text version of store_save: one "set" line per eviction set with its
+ * victim, then one line per element with its offset and, with translate, its
+ * physical address.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int
+store_export(const char *path, char *base, unsigned long size, const struct eviction_config_t *conf,
+	     const struct eviction_set_t *sets, int n, translate_fn translate, void *priv)
+{
+	uint64_t paddr = 0;
+	void **lines;
+	int i, j;
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		perror("open export");
+		return -1;
+	}
+	fprintf(f, "# %d sets, threshold %d, %d MB, %d ways, %d slices, stride %d, region %lu bytes\n", n,
+		conf->threshold, conf->cache_size >> 20, conf->cache_way, conf->cache_slices, conf->stride, size);
+	for (i = 0; i < n; i++) {
+		if (!(lines = lines_of(&sets[i]))) {
+			fclose(f);
+			return -1;
+		}
+		for (j = 0; j <= sets[i].len; j++) {
+			if (translate) {
+				translate(priv, &lines[j], &paddr, 1);
+			}
+			if (!j) {
+				fprintf(f, "set %d victim %#lx len %d", i, (unsigned long)((char *)lines[0] - base),
+					sets[i].len);
+			} else {
+				fprintf(f, "%#lx", (unsigned long)((char *)lines[j] - base));
+			}
+			if (translate) {
+				fprintf(f, " %#lx", (unsigned long)paddr);
+			}
+			fprintf(f, "\n");
+		}
+		free(lines);
+	}
+	return fclose(f) ? -1 : 0;
+}
+
+/*
+ * Links the lines at offs into a list, marked with color. The victim is
+ * offs[0].
+ */
+static void
+relink(char *base, const uint32_t *offs, int len, int color, struct eviction_set_t *es)
+{
+	cache_block_t *x, *tail = NULL;
+	int i;
+
+	es->victim = base + ((unsigned long)offs[0] << LINE_BITS);
+	es->set = NULL;
+	es->len = len;
+	for (i = 1; i <= len; i++) {
+		x = (cache_block_t *)(base + ((unsigned long)offs[i] << LINE_BITS));
+		x->set = color;
+		x->delta = 0;
+		x->next = NULL;
+		x->prev = tail;
+		if (tail) {
+			tail->next = x;
+		} else {
+			es->set = x;
+		}
+		tail = x;
+	}
+}
+
+/**
+ * Reads the sets of path into the region at base, which must be at least as
+ * large as the one they were saved from, and relinks them. The geometry must
+ * match conf; the stored threshold is taken over if conf->threshold <= 0.
+ * With translate and stored physical addresses, sets with a line that now
+ * translates differently are returned empty (set NULL, len 0).
+ *
+ * @param sets receives a malloc'ed array of the sets
+ * @return number of sets, or -1 on error.
+ */
+int
+store_load(const char *path, char *base, unsigned long size, struct eviction_config_t *conf,
+	   struct eviction_set_t **sets, translate_fn translate, void *priv)
+{
+	struct store_header_t h;
+	uint32_t len, *offs = NULL;
+	uint64_t *paddrs = NULL, now;
+	void *p, *q;
+	unsigned int i, j, moved = 0;
+	int ret = -1;
+	FILE *f = fopen(path, "rb");
+
+	*sets = NULL;
+	if (!f) {
+		perror("open store");
+		return -1;
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, STORE_MAGIC, sizeof(h.magic)) ||
+	    h.version != STORE_VERSION) {
+		printf("[!] Error: %s is not an eviction set file\n", path);
+		goto out;
+	}
+	if (h.cache_size != conf->cache_size || h.cache_way != conf->cache_way ||
+	    h.cache_slices != conf->cache_slices) {
+		printf("[!] Error: %s was saved for %d MB, %d ways, %d slices\n", path, h.cache_size >> 20,
+		       h.cache_way, h.cache_slices);
+		goto out;
+	}
+	if (h.size > size) {
+		printf("[!] Error: %s needs a region of %lu bytes, %lu mapped\n", path, (unsigned long)h.size, size);
+		goto out;
+	}
+	if (conf->threshold <= 0) {
+		conf->threshold = h.threshold;
+	}
+
+	*sets = (struct eviction_set_t *)calloc(h.nsets ? h.nsets : 1, sizeof(**sets));
+	if (!*sets) {
+		goto out;
+	}
+	for (i = 0; i < h.nsets; i++) {
+		if (fread(&len, sizeof(len), 1, f) != 1 || len > h.size >> LINE_BITS) {
+			goto bad;
+		}
+		if ((p = realloc(offs, (len + 1) * sizeof(uint32_t)))) {
+			offs = (uint32_t *)p;
+		}
+		if ((q = realloc(paddrs, (len + 1) * sizeof(uint64_t)))) {
+			paddrs = (uint64_t *)q;
+		}
+		if (!p || !q || fread(offs, sizeof(uint32_t), len + 1, f) != len + 1) {
+			goto bad;
+		}
+		for (j = 0; j <= len; j++) {
+			if (((uint64_t)offs[j] << LINE_BITS) >= h.size) {
+				goto bad;
+			}
+		}
+		if ((h.flags & STORE_PADDRS) && fread(paddrs, sizeof(uint64_t), len + 1, f) != len + 1) {
+			goto bad;
+		}
+
+		relink(base, offs, len, i, &(*sets)[i]);
+
+		for (j = 0; translate && (h.flags & STORE_PADDRS) && j <= len; j++) {
+			p = base + ((unsigned long)offs[j] << LINE_BITS);
+			translate(priv, &p, &now, 1);
+			if (now != PADDR_INVALID && paddrs[j] != PADDR_INVALID && now != paddrs[j]) {
+				(*sets)[i].set = NULL;
+				(*sets)[i].len = 0;
+				moved++;
+				break;
+			}
+		}
+	}
+	if (moved) {
+		printf("[!] %u of %u sets changed physical addresses\n", moved, h.nsets);
+	}
+	ret = h.nsets;
+	goto out;
+bad:
+	printf("[!] Error: %s is truncated or corrupt (set %u)\n", path, i);
+	free(*sets);
+	*sets = NULL;
+out:
+	free(offs);
+	free(paddrs);
+	fclose(f);
+	return ret;
+}
+
+static cache_block_t *
+last(struct eviction_set_t *es)
+{
+	cache_block_t *x = es->set;
+	int i;
+
+	for (i = 1; i < es->len; i++) {
+		x = x->next;
+	}
+	return x;
+}
+
+static int
+contains(const long *a, int n, long x)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (a[i] == x) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Revalidates loaded sets with one test per set. Up to ORACLE_MAX_BATCH sets
+ * are linked into a single list and their victims are timed together after
+ * one traversal (oracle_test_batch). A set can only evict victims of its own
+ * cache set index, so a batch never holds two sets whose victims translate
+ * to the same set index: each victim then only depends on its own set.
+ * Without translate, or for victims that do not translate, every set is
+ * tested alone. Victims that stay cached are retested alone before their set
+ * is rejected.
+ *
+ * @param valid receives 1 for each set that still evicts its victim
+ * @return number of valid sets, or -1 on allocation failure.
+ */
+int
+store_validate(struct eviction_config_t *conf, struct eviction_set_t *sets, int n, translate_fn translate,
+	       void *priv, int *valid)
+{
+	char *victims[ORACLE_MAX_BATCH];
+	int idx[ORACLE_MAX_BATCH], evicted[ORACLE_MAX_BATCH];
+	long index[ORACLE_MAX_BATCH];
+	unsigned long mask = conf->cache_size / (64 * conf->cache_way * conf->cache_slices) - 1;
+	uint64_t *paddrs = (uint64_t *)malloc((n ? n : 1) * sizeof(uint64_t));
+	int *pending = (int *)malloc((n ? n : 1) * sizeof(int));
+	cache_block_t *head, *tail;
+	int i, j, k, m, len, left = 0, ret = 0;
+
+	if (!paddrs || !pending) {
+		free(paddrs);
+		free(pending);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		valid[i] = 0;
+		paddrs[i] = PADDR_INVALID;
+		if (sets[i].set) {
+			pending[left++] = i;
+		}
+	}
+	if (translate) {
+		void **v = (void **)malloc((n ? n : 1) * sizeof(void *));
+		for (i = 0; v && i < n; i++) {
+			v[i] = sets[i].victim;
+		}
+		if (v) {
+			translate(priv, v, paddrs, n);
+		}
+		free(v);
+	}
+
+	while (left) {
+		head = tail = NULL;
+		len = m = 0;
+		// Sets that do not fit this batch stay pending, in order
+		for (i = j = 0; i < left; i++) {
+			struct eviction_set_t *es = &sets[pending[i]];
+			long x = paddrs[pending[i]] == PADDR_INVALID ? -1 : (long)((paddrs[pending[i]] >> LINE_BITS) & mask);
+
+			if (m == ORACLE_MAX_BATCH || (m && (x < 0 || index[0] < 0 || contains(index, m, x)))) {
+				pending[j++] = pending[i];
+				continue;
+			}
+			if (tail) {
+				tail->next = es->set;
+				es->set->prev = tail;
+			} else {
+				head = es->set;
+			}
+			tail = last(es);
+			len += es->len;
+			victims[m] = es->victim;
+			index[m] = x;
+			idx[m++] = pending[i];
+		}
+		left = j;
+
+		oracle_test_batch(conf, head, len, victims, m, evicted);
+
+		// Split the list back into its sets
+		for (k = 0; k < m; k++) {
+			sets[idx[k]].set->prev = NULL;
+			last(&sets[idx[k]])->next = NULL;
+		}
+
+		for (k = 0; k < m; k++) {
+			struct eviction_set_t *es = &sets[idx[k]];
+			valid[idx[k]] = evicted[k] || oracle_test_len(conf, es->set, es->len, es->victim);
+			ret += valid[idx[k]];
+		}
+	}
+	free(paddrs);
+	free(pending);
+	return ret;
+}
@@ -0,0 +1,49 @@
+#ifndef store_H
+#define store_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "eviction.h"
+#include "physical.h"
+
+/*
+ * Eviction sets on disk. Lines and victims are stored as offsets into the
+ * memory region they were found in (the pool mapping), in units of 64B
+ * lines, together with the threshold and the cache geometry, and optionally
+ * with the physical address of every line. With a pool that keeps its pages
+ * across runs (pool.h, hugetlbfs), a loaded file only needs one validation
+ * pass instead of a new search.
+ *
+ * Binary layout, in the byte order and struct layout of the machine that
+ * wrote it (files are not portable across architectures): a struct
+ * store_header_t, then per set a
+ * uint32 length, the uint32 victim offset, the uint32 line offsets and, with
+ * STORE_PADDRS, length + 1 uint64 physical addresses (victim first).
+ */
+
+#define STORE_MAGIC "EVST"
+#define STORE_VERSION 1
+#define STORE_PADDRS 1
+
+struct store_header_t {
+	char magic[4];
+	uint16_t version;
+	uint16_t flags;
+	uint32_t nsets;
+	int32_t threshold;
+	int32_t cache_size, cache_way, cache_slices, stride;
+	uint64_t size; // of the region offsets point into
+};
+
+int store_save(const char *path, char *base, unsigned long size, const struct eviction_config_t *conf,
+	       const struct eviction_set_t *sets, int n, translate_fn translate, void *priv);
+int store_export(const char *path, char *base, unsigned long size, const struct eviction_config_t *conf,
+		 const struct eviction_set_t *sets, int n, translate_fn translate, void *priv);
+int store_load(const char *path, char *base, unsigned long size, struct eviction_config_t *conf,
+	       struct eviction_set_t **sets, translate_fn translate, void *priv);
+
+int store_validate(struct eviction_config_t *conf, struct eviction_set_t *sets, int n, translate_fn translate,
+		   void *priv, int *valid);
+
+#endif /* store_H */
@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include "threshold.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LINE_LEN 512
+
+static void
+chomp(char *s)
+{
+	s[strcspn(s, "\r\n")] = '\0';
+}
+
+static void
+cpu_model(char *model, size_t len)
+{
+	char line[LINE_LEN];
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	snprintf(model, len, "unknown");
+	if (!f) {
+		return;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		char *sep = strchr(line, ':');
+		if (!strncmp(line, "model name", 10) && sep) {
+			chomp(sep);
+			snprintf(model, len, "%s", sep + 2);
+			break;
+		}
+	}
+	fclose(f);
+}
+
+static void
+cpu_governor(int cpu, char *governor, size_t len)
+{
+	char path[128];
+	FILE *f;
+
+	snprintf(governor, len, "none");
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+	f = fopen(path, "r");
+	if (!f) {
+		return;
+	}
+	if (fgets(governor, len, f)) {
+		chomp(governor);
+	}
+	fclose(f);
+}
+
+/**
+ * Builds the cache key for the core the caller is running on.
+ *
+ * @return core number, or -1 if it could not be determined.
+ */
+int
+threshold_key(char *key, size_t len)
+{
+	char model[128], governor[64];
+	int cpu = sched_getcpu();
+
+	cpu_model(model, sizeof(model));
+	cpu_governor(cpu < 0 ? 0 : cpu, governor, sizeof(governor));
+	snprintf(key, len, "%s;%s;cpu%d", model, governor, cpu);
+	return cpu;
+}
+
+/**
+ * @return 0 and sets threshold if key is cached, otherwise 1.
+ */
+int
+threshold_load(const char *path, const char *key, int *threshold)
+{
+	char line[LINE_LEN];
+	size_t klen = strlen(key);
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, key, klen) && line[klen] == '\t') {
+			*threshold = atoi(&line[klen + 1]);
+			fclose(f);
+			return *threshold <= 0;
+		}
+	}
+	fclose(f);
+	return 1;
+}
+
+/**
+ * Replaces or appends the entry for key. The file is rewritten through a
+ * temporary and renamed, so concurrent runs never see a partial file.
+ *
+ * @return 0 on success.
+ */
+int
+threshold_save(const char *path, const char *key, int threshold)
+{
+	char line[LINE_LEN], tmp[LINE_LEN];
+	size_t klen = strlen(key);
+	FILE *in, *out;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+	out = fopen(tmp, "w");
+	if (!out) {
+		return 1;
+	}
+	in = fopen(path, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if (!strncmp(line, key, klen) && line[klen] == '\t') {
+				continue;
+			}
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+	fprintf(out, "%s\t%d\n", key, threshold);
+	if (fclose(out) || rename(tmp, path)) {
+		remove(tmp);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef threshold_H
+#define threshold_H
+
+#include <stdlib.h>
+
+/*
+ * On-disk cache of calibrated thresholds, one "key<TAB>threshold" line per
+ * entry. The key identifies the measuring context: CPU model, frequency
+ * governor and core the calibration ran on.
+ */
+int threshold_key(char *key, size_t len);
+int threshold_load(const char *path, const char *key, int *threshold);
+int threshold_save(const char *path, const char *key, int threshold);
+
+#endif /* threshold_H */
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+#include "timer.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef THREAD_COUNTER
+enum timer_kind timer_kind = TIMER_COUNTER;
+#else
+enum timer_kind timer_kind = TIMER_RDTSC;
+#endif
+
+volatile uint64_t timer_counter;
+
+static pthread_t counter_thread;
+static volatile int counter_running;
+
+static void *
+count(void *arg)
+{
+	(void)arg;
+	while (counter_running) {
+		timer_counter++;
+	}
+	return NULL;
+}
+
+// Another hardware thread of the caller's core, otherwise any other CPU
+static int
+sibling_cpu(void)
+{
+	char path[128], list[256], *tok;
+	int self = sched_getcpu(), cpu;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", self);
+	f = fopen(path, "r");
+	if (f) {
+		if (fgets(list, sizeof(list), f)) {
+			for (tok = strtok(list, ",-\n"); tok; tok = strtok(NULL, ",-\n")) {
+				cpu = atoi(tok);
+				if (cpu != self) {
+					fclose(f);
+					return cpu;
+				}
+			}
+		}
+		fclose(f);
+	}
+	return self == 0 ? 1 : 0;
+}
+
+/**
+ * Selects the timer. For TIMER_COUNTER, starts the counting thread pinned to
+ * cpu (a sibling of the calling thread's core if cpu < 0) and waits until it
+ * is counting. Calling it again with the counter running is a no-op.
+ *
+ * @return 0 on success.
+ */
+int
+timer_init(enum timer_kind kind, int cpu)
+{
+	cpu_set_t mask;
+	uint64_t start;
+
+	timer_kind = kind;
+	if (kind != TIMER_COUNTER || counter_running) {
+		return 0;
+	}
+
+	counter_running = 1;
+	if (pthread_create(&counter_thread, NULL, count, NULL)) {
+		counter_running = 0;
+		return 1;
+	}
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu < 0 ? sibling_cpu() : cpu, &mask);
+	if (pthread_setaffinity_np(counter_thread, sizeof(mask), &mask)) {
+		printf("[!] Warning: counting thread left unpinned\n");
+	}
+
+	start = timer_counter;
+	while (timer_counter == start) {
+		sched_yield();
+	}
+	return 0;
+}
+
+void
+timer_stop(void)
+{
+	if (counter_running) {
+		counter_running = 0;
+		pthread_join(counter_thread, NULL);
+	}
+}
+
+int
+timer_parse(const char *name, enum timer_kind *kind)
+{
+	if (!strcmp(name, "rdtsc")) {
+		*kind = TIMER_RDTSC;
+	} else if (!strcmp(name, "rdtscp")) {
+		*kind = TIMER_RDTSCP;
+	} else if (!strcmp(name, "counter")) {
+		*kind = TIMER_COUNTER;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+const char *
+timer_name(enum timer_kind kind)
+{
+	switch (kind) {
+	case TIMER_RDTSCP:
+		return "rdtscp";
+	case TIMER_COUNTER:
+		return "counter";
+	default:
+		return "rdtsc";
+	}
+}
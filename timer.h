@@ -0,0 +1,44 @@
+#ifndef timer_H
+#define timer_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+enum timer_kind {
+	TIMER_RDTSC, // lfence; rdtsc; lfence
+	TIMER_RDTSCP, // rdtscp; lfence
+	TIMER_COUNTER, // shared counter incremented by a thread on a sibling core
+};
+
+extern enum timer_kind timer_kind;
+extern volatile uint64_t timer_counter;
+
+int timer_init(enum timer_kind kind, int cpu);
+void timer_stop(void);
+int timer_parse(const char *name, enum timer_kind *kind);
+const char *timer_name(enum timer_kind kind);
+
+static inline uint64_t
+timer_now(void)
+{
+	uint64_t a, d;
+
+	switch (timer_kind) {
+	case TIMER_RDTSCP:
+		__asm__ volatile("rdtscp" : "=a"(a), "=d"(d) : : "rcx");
+		__asm__ volatile("lfence");
+		return ((d << 32) | a);
+	case TIMER_COUNTER:
+		__asm__ volatile("lfence");
+		a = timer_counter;
+		__asm__ volatile("lfence");
+		return a;
+	default:
+		__asm__ volatile("lfence");
+		__asm__ volatile("rdtsc" : "=a"(a), "=d"(d) : :);
+		__asm__ volatile("lfence");
+		return ((d << 32) | a);
+	}
+}
+
+#endif /* timer_H */
@@ -0,0 +1,145 @@
+#include "trace.h"
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const char *phases[] = {
+	"calibrate", "pick", "initial", "conflict", "level", "backtrack", "reduce", "run",
+};
+
+/**
+ * Sets up tr. With perf, LLC read misses of this thread in user space are
+ * counted while tests run.
+ *
+ * @return 0 on success, -1 if perf was requested but is not available (the
+ * trace is then usable without miss counts).
+ */
+int
+trace_init(struct trace_t *tr, trace_sink sink, void *priv, int perf)
+{
+	struct perf_event_attr attr;
+
+	tr->sink = sink;
+	tr->priv = priv;
+	tr->perf_fd = -1;
+	tr->tests = 0;
+	tr->lines = 0;
+	tr->n = 0;
+	if (!perf) {
+		return 0;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	tr->perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	return tr->perf_fd < 0 ? -1 : 0;
+}
+
+void
+trace_close(struct trace_t *tr)
+{
+	trace_flush(tr);
+	if (tr->perf_fd >= 0) {
+		close(tr->perf_fd);
+		tr->perf_fd = -1;
+	}
+}
+
+/**
+ * Hands the buffered records to the sink, in order, and empties the buffer.
+ */
+void
+trace_flush(struct trace_t *tr)
+{
+	int i;
+
+	if (!tr) {
+		return;
+	}
+	for (i = 0; tr->sink && i < tr->n; i++) {
+		tr->sink(tr->priv, &tr->records[i]);
+	}
+	tr->n = 0;
+}
+
+uint64_t
+trace_misses(struct trace_t *tr)
+{
+	uint64_t count = 0;
+
+	if (tr->perf_fd < 0 || read(tr->perf_fd, &count, sizeof(count)) != sizeof(count)) {
+		return 0;
+	}
+	return count;
+}
+
+void
+trace_perf_enable(struct trace_t *tr)
+{
+	if (tr && tr->perf_fd >= 0) {
+		ioctl(tr->perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void
+trace_perf_disable(struct trace_t *tr)
+{
+	if (tr && tr->perf_fd >= 0) {
+		ioctl(tr->perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+	}
+}
+
+const char *
+trace_phase_name(enum trace_phase phase)
+{
+	return phase <= TRACE_RUN ? phases[phase] : "unknown";
+}
+
+/**
+ * Sink for humans, priv is unused. Levels keep the format of the former
+ * progress lines of the reduction.
+ */
+void
+trace_print(void *priv, const struct trace_record_t *r)
+{
+	(void)priv;
+
+	switch (r->phase) {
+	case TRACE_LEVEL:
+		printf("\tlvl=%d: eset=%d, removed=%d (%d), %lu tests, %llu cycles\n", r->level, r->len, r->removed,
+		       r->len + r->removed, r->tests, (unsigned long long)r->cycles);
+		break;
+	case TRACE_BACKTRACK:
+		printf("\tbacktracking step (lvl=%d)\n", r->level);
+		break;
+	default:
+		printf("\t%s: %llu cycles, %lu tests, %lu lines", trace_phase_name(r->phase),
+		       (unsigned long long)r->cycles, r->tests, r->lines);
+		if (r->misses) {
+			printf(", %llu LLC misses", (unsigned long long)r->misses);
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * Sink writing one JSON object per line to the FILE * in priv.
+ */
+void
+trace_json(void *priv, const struct trace_record_t *r)
+{
+	fprintf((FILE *)priv,
+		"{\"phase\": \"%s\", \"level\": %d, \"len\": %d, \"removed\": %d, \"cycles\": %llu, "
+		"\"tests\": %lu, \"lines\": %lu, \"misses\": %llu}\n",
+		trace_phase_name(r->phase), r->level, r->len, r->removed, (unsigned long long)r->cycles, r->tests,
+		r->lines, (unsigned long long)r->misses);
+}
@@ -0,0 +1,113 @@
+#ifndef trace_H
+#define trace_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Instrumentation of a search. Phases are bracketed by a mark and a record:
+ * the record holds the cycles (rdtsc), tests, lines traversed and, with
+ * perf, LLC misses during tests since the mark. Records are only appended to
+ * a buffer on the hot path, and handed to the sink by trace_flush once the
+ * search is done (or when the buffer fills up), so that no printing or I/O
+ * runs between the tests of a reduction.
+ *
+ * A trace is used by one thread at a time. A NULL trace disables all of it.
+ */
+
+#define TRACE_MAX_RECORDS 1024
+
+enum trace_phase {
+	TRACE_CALIBRATE,
+	TRACE_PICK, // initial set
+	TRACE_INITIAL, // test of the initial set
+	TRACE_CONFLICT, // conflict set build
+	TRACE_LEVEL, // one reduction level
+	TRACE_BACKTRACK, // level undone
+	TRACE_REDUCE, // whole reduction
+	TRACE_RUN, // whole search, for one victim
+};
+
+struct trace_record_t {
+	enum trace_phase phase;
+	int level; // TRACE_LEVEL, TRACE_BACKTRACK: level, otherwise -1
+	int len; // candidate lines after the phase, -1 if not applicable
+	int removed; // TRACE_LEVEL: lines discarded so far
+	uint64_t cycles;
+	unsigned long tests, lines;
+	uint64_t misses; // LLC misses during tests (0 without perf)
+};
+
+typedef void (*trace_sink)(void *priv, const struct trace_record_t *r);
+
+struct trace_mark_t {
+	uint64_t cycles;
+	unsigned long tests, lines;
+	uint64_t misses;
+};
+
+struct trace_t {
+	trace_sink sink;
+	void *priv;
+	int perf_fd; // -1: no LLC miss counts
+
+	// Running totals, updated by oracle_test
+	unsigned long tests, lines;
+
+	int n;
+	struct trace_record_t records[TRACE_MAX_RECORDS];
+};
+
+int trace_init(struct trace_t *tr, trace_sink sink, void *priv, int perf);
+void trace_close(struct trace_t *tr);
+void trace_flush(struct trace_t *tr);
+uint64_t trace_misses(struct trace_t *tr);
+
+const char *trace_phase_name(enum trace_phase phase);
+void trace_print(void *priv, const struct trace_record_t *r);
+void trace_json(void *priv, const struct trace_record_t *r);
+
+void trace_perf_enable(struct trace_t *tr);
+void trace_perf_disable(struct trace_t *tr);
+
+static inline void
+trace_mark(struct trace_t *tr, struct trace_mark_t *m)
+{
+	if (!tr) {
+		*m = (struct trace_mark_t){ 0 };
+		return;
+	}
+	m->cycles = __builtin_ia32_rdtsc();
+	m->tests = tr->tests;
+	m->lines = tr->lines;
+	m->misses = tr->perf_fd >= 0 ? trace_misses(tr) : 0;
+}
+
+/**
+ * Appends the phase since m. Flushes first if the buffer is full.
+ */
+static inline void
+trace_record(struct trace_t *tr, const struct trace_mark_t *m, enum trace_phase phase, int level, int len,
+	     int removed)
+{
+	struct trace_record_t *r;
+
+	if (!tr) {
+		return;
+	}
+	if (tr->n == TRACE_MAX_RECORDS) {
+		trace_flush(tr);
+	}
+	r = &tr->records[tr->n++];
+	r->phase = phase;
+	r->level = level;
+	r->len = len;
+	r->removed = removed;
+	r->cycles = __builtin_ia32_rdtsc() - m->cycles;
+	r->tests = tr->tests - m->tests;
+	r->lines = tr->lines - m->lines;
+	r->misses = tr->perf_fd >= 0 ? trace_misses(tr) - m->misses : 0;
+}
+
+#endif /* trace_H */
@@ -0,0 +1,54 @@
+#include "traversal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// -e 0..4, in the order of the original evsets strategies
+static const struct traversal_t traversals[] = {
+	{ "haswell", 1, 2, 1, 0 },
+	{ "skylake", 2, 3, 1, 0 },
+	{ "simple", 1, 1, 1, 0 },
+	{ "skylake-fb", 2, 3, 1, 1 },
+	{ "haswell-fb", 1, 2, 1, 1 },
+};
+
+const struct traversal_t *
+traversal_get(int id)
+{
+	if (id < 0 || id >= (int)(sizeof(traversals) / sizeof(traversals[0]))) {
+		return NULL;
+	}
+	return &traversals[id];
+}
+
+/**
+ * Parses -e: a preset id, or "repeat,window,step[,back]" stored in custom.
+ *
+ * @return 0 on success, -1 on a malformed or unknown strategy.
+ */
+int
+traversal_parse(const char *arg, struct traversal_t *custom, const struct traversal_t **t)
+{
+	int id, n;
+
+	custom->back = 0;
+	n = sscanf(arg, "%d,%d,%d,%d", &custom->repeat, &custom->window, &custom->step, &custom->back);
+	if (n >= 3) {
+		if (custom->repeat < 1 || custom->window < 1 || custom->step < 1) {
+			return -1;
+		}
+		custom->name = "custom";
+		*t = custom;
+		return 0;
+	}
+	if (n != 1 || sscanf(arg, "%d", &id) != 1 || !(*t = traversal_get(id))) {
+		return -1;
+	}
+	return 0;
+}
+
+const char *
+traversal_name(const struct traversal_t *t)
+{
+	return t ? t->name : "simple";
+}
@@ -0,0 +1,59 @@
+#ifndef traversal_H
+#define traversal_H
+
+#include <stdlib.h>
+
+#include "eviction.h"
+
+/*
+ * Eviction strategies as parameterized traversals (rowhammer.js style): a
+ * window of `window` consecutive lines is accessed `repeat` times, then the
+ * window slides by `step` lines. With `back`, the list is walked once more
+ * from its tail using prev, which defeats the adjacent line prefetcher and
+ * ages lines again on policies that insert at a non-MRU position (QLRU).
+ */
+struct traversal_t {
+	const char *name;
+	int repeat, window, step;
+	int back;
+};
+
+#define TRAVERSAL_SIMPLE 2
+
+const struct traversal_t *traversal_get(int id);
+int traversal_parse(const char *arg, struct traversal_t *custom, const struct traversal_t **t);
+const char *traversal_name(const struct traversal_t *t);
+
+/**
+ * Runs t over set, calling access once per memory access. Shared by the
+ * timed kernels and the simulator so that both see the same sequence.
+ *
+ * @return number of lines in set.
+ */
+static inline int
+traverse_pattern(cache_block_t *set, const struct traversal_t *t, void (*access)(void *ctx, void *p), void *ctx)
+{
+	cache_block_t *p = set, *q, *last = NULL;
+	int i, r, n = 0;
+
+	while (p) {
+		for (r = 0; r < t->repeat; r++) {
+			for (q = p, i = 0; q && i < t->window; i++, q = q->next) {
+				access(ctx, q);
+			}
+		}
+		for (i = 0; p && i < t->step; i++, n++) {
+			last = p;
+			p = p->next;
+		}
+	}
+
+	// Stop at a stale prev, not every relink keeps them up to date
+	for (p = last, i = 0; t->back && p && i < n; i++) {
+		access(ctx, p);
+		p = p->prev && p->prev->next == p ? p->prev : NULL;
+	}
+	return n;
+}
+
+#endif /* traversal_H */